@@ -11,6 +11,15 @@ DTYPE_MAP = {
 }
 DTYPE_ITEMSIZE = {1: 4, 2: 2, 3: 8, 4: 8, 5: 4, 6: 1}
 
+# Payloads start on 64-byte boundaries so the loader can mmap the file and use the
+# tensors in place (unaligned payloads are copied). Offsets are absolute, so the
+# padding is invisible to readers.
+ALIGN = 64
+
+
+def align_up(x, a=ALIGN):
+    return (x + a - 1) // a * a
+
 
 def dump_tbf1(model, path):
     entries, blobs = [], []
@@ -33,7 +42,7 @@ def dump_tbf1(model, path):
             }
         )
         blobs.append(entries[-1]["arr"])
-        offset += nbytes
+        offset = align_up(offset + nbytes)
 
     # Compute absolute start of data section: magic(4) + count(8) + per-entry headers
     data_start = 4 + 8
@@ -42,6 +51,7 @@ def dump_tbf1(model, path):
         rank = len(e["shape"])
         # name_len(2) + name + dtype(1) + rank(1) + dims(4*rank) + offset(8) + nbytes(8)
         data_start += 2 + name_len + 1 + 1 + 4 * rank + 8 + 8
+    data_start = align_up(data_start)
 
     # backpatch the offsets
     for e in entries:
@@ -65,6 +75,7 @@ def dump_tbf1(model, path):
 
         for b, e in zip(blobs, entries):
             print(f"{e['name']:50} | offset={e['offset']:10} | nbytes={e['nbytes']:10}")
+            f.write(b"\0" * (e["offset"] - f.tell()))
             f.write(b)
 
 
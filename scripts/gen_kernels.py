@@ -0,0 +1,239 @@
+"""Shape-specialized kernel generator.
+
+Writes a C header of fully unrolled layer norm and attention kernels for one model's
+fixed dimensions. The Makefile runs it at build time and kernels_isa.c includes the
+result in every ISA build (-DKERNELS_FIXED); calls whose shapes do not match fall back
+to the general kernels.
+
+The code is written against the small vf_* vector layer kernels_isa.c defines for each
+build (vf_t of VF_W floats), so one section is emitted per vector width:
+
+    layer_norm_row_fixed   a whole row of `hidden` floats, held in registers when it fits
+    attention_fixed        head size `head_dim` and at most `max_tokens` keys: one softmax
+                           pass over all scores, whose accumulators and the output row stay
+                           in registers
+
+Usage:
+    python scripts/gen_kernels.py --hidden 384 --head-dim 32 --max-tokens 128 -o kernels_fixed.h
+"""
+
+import argparse
+import sys
+
+# (vector width in floats, vector registers of the ISA)
+WIDTHS = [(16, 32), (8, 16), (4, 16)]
+# registers left for temporaries when deciding whether a layer norm row stays resident
+SPARE_REGS = 8
+# independent FMA chains needed to cover the FMA latency
+FMA_CHAINS = 8
+
+
+class Emitter:
+    def __init__(self):
+        self.lines = []
+        self.depth = 0
+
+    def __call__(self, line=""):
+        self.lines.append("    " * self.depth + line if line else "")
+
+    def open(self, line=None):
+        if line:
+            self(line)
+        self("{")
+        self.depth += 1
+
+    def close(self, suffix=""):
+        self.depth -= 1
+        self("}" + suffix)
+
+
+def reduce_tree(e, op, names):
+    """Emit `names[0] = op(...)` summing all of names pairwise, so the chains stay independent"""
+    while len(names) > 1:
+        nxt = []
+        for i in range(0, len(names) - 1, 2):
+            e(f"{names[i]} = {op}({names[i]}, {names[i + 1]});")
+            nxt.append(names[i])
+        if len(names) % 2:
+            nxt.append(names[-1])
+        names = nxt
+    return names[0]
+
+
+def layer_norm(e, n, w, regs):
+    nv = n // w
+    resident = nv <= regs - SPARE_REGS
+    e("// out may alias x: every element is read before it is written")
+    e("static void layer_norm_row_fixed(float *out, const float *x,")
+    e("                                 const float *__restrict gamma, const float *__restrict beta, float eps)")
+    e.open()
+    chains = min(4, nv)
+    if resident:
+        # exact two-pass statistics from registers
+        for i in range(nv):
+            e(f"const vf_t x{i} = vf_load(x + {i * w});")
+        for c in range(chains):
+            e(f"vf_t s{c} = x{c};")
+        for i in range(chains, nv):
+            e(f"s{i % chains} = vf_add(s{i % chains}, x{i});")
+        s = reduce_tree(e, "vf_add", [f"s{c}" for c in range(chains)])
+        e(f"const float mean = vf_hsum({s}) * (1.0f / {n});")
+        e("const vf_t vmean = vf_set1(mean);")
+        for i in range(nv):
+            e(f"const vf_t d{i} = vf_sub(x{i}, vmean);")
+        for c in range(chains):
+            e(f"vf_t q{c} = vf_mul(d{c}, d{c});")
+        for i in range(chains, nv):
+            e(f"q{i % chains} = vf_fmadd(d{i}, d{i}, q{i % chains});")
+        q = reduce_tree(e, "vf_add", [f"q{c}" for c in range(chains)])
+        e(f"const vf_t vinv = vf_set1(1.0f / sqrtf(vf_hsum({q}) * (1.0f / {n}) + eps));")
+        for i in range(nv):
+            e(f"vf_store(out + {i * w}, vf_fmadd(vf_mul(d{i}, vinv), vf_load(gamma + {i * w}), vf_load(beta + {i * w})));")
+    else:
+        # single-pass statistics over x - x[0], as layer_norm_row, then an output pass
+        e("const float shift = x[0];")
+        e("const vf_t vshift = vf_set1(shift);")
+        for c in range(chains):
+            e(f"vf_t s{c} = vf_zero(), q{c} = vf_zero();")
+        for i in range(nv):
+            c = i % chains
+            e(f"{{ const vf_t d = vf_sub(vf_load(x + {i * w}), vshift); s{c} = vf_add(s{c}, d); q{c} = vf_fmadd(d, d, q{c}); }}")
+        s = reduce_tree(e, "vf_add", [f"s{c}" for c in range(chains)])
+        q = reduce_tree(e, "vf_add", [f"q{c}" for c in range(chains)])
+        e(f"const float mean_d = vf_hsum({s}) * (1.0f / {n});")
+        e(f"const float var = fmaxf(vf_hsum({q}) * (1.0f / {n}) - mean_d * mean_d, 0.0f);")
+        e("const vf_t vmean = vf_set1(shift + mean_d), vinv = vf_set1(1.0f / sqrtf(var + eps));")
+        for i in range(nv):
+            e(f"vf_store(out + {i * w}, vf_fmadd(vf_mul(vf_sub(vf_load(x + {i * w}), vmean), vinv), "
+              f"vf_load(gamma + {i * w}), vf_load(beta + {i * w})));")
+    e.close()
+
+
+def attention(e, d, t, w):
+    dv = d // w
+    # score vectors per key chunk: all keys on AVX-512, as many as leave room for loads
+    nv_max = min(t // w, 8)
+    kb = nv_max * w
+    banks = max(1, FMA_CHAINS // dv)
+
+    e(f"// Keys are transposed once per call into kt[{d}][{t}], zero-padded to whole vectors, so")
+    e(f"// each query row is one pass: scores for chunks of {kb} keys in {nv_max} accumulators")
+    e(f"// unrolled over the head dimension, a plain softmax, then p x v into {banks} bank(s) of")
+    e(f"// {dv} output vectors.")
+    e("static void attention_fixed(const float *q, size_t ldq, size_t n_q,")
+    e("                            const float *k, const float *v, size_t ldkv, size_t n_kv,")
+    e("                            const float *mask, float scale, float *o, size_t ldo)")
+    e.open()
+    e(f"_Alignas(64) float kt[{d} * {t}];")
+    e(f"_Alignas(64) float s[{t}];")
+    e(f"const size_t n_pad = (n_kv + {w - 1}) / {w} * {w};")
+    e(f"transpose(kt, {t}, k, ldkv, n_kv, {d});")
+    e(f"for (size_t c = 0; c < {d}; ++c)")
+    e(f"    for (size_t j = n_kv; j < n_pad; ++j)")
+    e(f"        kt[c * {t} + j] = 0.0f;")
+    e("const vf_t vscale = vf_set1(scale);")
+    e()
+    e.open("for (size_t i = 0; i < n_q; ++i)")
+    e("const float *q_row = q + i * ldq;")
+    e.open(f"for (size_t j0 = 0; j0 < n_pad; j0 += {kb})")
+    e("const float *kt0 = kt + j0;")
+    e(f"const size_t nv = n_pad - j0 < {kb} ? (n_pad - j0) / {w} : {nv_max};")
+    e.open("switch (nv)")
+    for nv in range(nv_max, 0, -1):
+        e(f"case {nv}:")
+        e.open()
+        e(" ".join(f"vf_t a{m} = vf_zero();" for m in range(nv)))
+        for c in range(d):
+            loads = " ".join(f"a{m} = vf_fmadd(qc, vf_load(kt0 + {c * t + m * w}), a{m});" for m in range(nv))
+            e(f"{{ const vf_t qc = vf_set1(q_row[{c}]); {loads} }}")
+        for m in range(nv):
+            e(f"vf_store(s + j0 + {m * w}, vf_mul(a{m}, vscale));")
+        e("break;")
+        e.close()
+    e.close()
+    e.close()
+    e()
+    e("if (mask)")
+    e("    for (size_t j = 0; j < n_kv; ++j)")
+    e("        s[j] = mask[j] == 0.0f ? ATTN_MASKED : s[j];")
+    e("float row_max = -FLT_MAX, row_sum = 0.0f;")
+    e("for (size_t j = 0; j < n_kv; ++j)")
+    e("    row_max = fmaxf(row_max, s[j]);")
+    e.open("for (size_t j = 0; j < n_kv; ++j)")
+    e("s[j] = vexpf(s[j] - row_max);")
+    e("row_sum += s[j];")
+    e.close()
+    e()
+    acc = [[f"o{b}_{m}" for m in range(dv)] for b in range(banks)]
+    for b in range(banks):
+        e(" ".join(f"vf_t {name} = vf_zero();" for name in acc[b]))
+
+    def pv(offset, bank):
+        e.open()
+        e(f"const vf_t p = vf_set1(s[j + {offset}]);")
+        e(f"const float *v_row = v + (j + {offset}) * ldkv;")
+        for m, name in enumerate(acc[bank]):
+            e(f"{name} = vf_fmadd(p, vf_load(v_row + {m * w}), {name});")
+        e.close()
+
+    e("size_t j = 0;")
+    if banks > 1:
+        e.open(f"for (; j + {banks} <= n_kv; j += {banks})")
+        for b in range(banks):
+            pv(b, b)
+        e.close()
+    e.open("for (; j < n_kv; ++j)")
+    pv(0, 0)
+    e.close()
+    e("const vf_t vinv = vf_set1(1.0f / row_sum);")
+    e("float *o_row = o + i * ldo;")
+    for m in range(dv):
+        total = reduce_tree(e, "vf_add", [acc[b][m] for b in range(banks)])
+        e(f"vf_store(o_row + {m * w}, vf_mul({total}, vinv));")
+    e.close()
+    e.close()
+
+
+def generate(hidden, head_dim, max_tokens):
+    e = Emitter()
+    e(f"// kernels_fixed.h — generated by scripts/gen_kernels.py --hidden {hidden} --head-dim {head_dim} "
+      f"--max-tokens {max_tokens}; do not edit")
+    e("// Included by kernels_isa.c after its vf_* vector layer, see that file.")
+    e("#pragma once")
+    e()
+    e(f"#define KERNELS_FIXED_HIDDEN {hidden}")
+    e(f"#define KERNELS_FIXED_HEAD_DIM {head_dim}")
+    e(f"#define KERNELS_FIXED_MAX_TOKENS {max_tokens}")
+    for i, (w, regs) in enumerate(WIDTHS):
+        e()
+        e(f"#{'if' if i == 0 else 'elif'} VF_W == {w}")
+        e()
+        layer_norm(e, hidden, w, regs)
+        e()
+        attention(e, head_dim, max_tokens, w)
+    e()
+    e("#else")
+    e('#error "no generated kernels for this VF_W"')
+    e("#endif")
+    return "\n".join(e.lines) + "\n"
+
+
+def main(argv):
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--hidden", type=int, required=True, help="layer norm row length")
+    ap.add_argument("--head-dim", type=int, required=True, help="attention head size")
+    ap.add_argument("--max-tokens", type=int, required=True, help="longest sequence (keys per attention call)")
+    ap.add_argument("-o", "--output", required=True)
+    args = ap.parse_args(argv)
+    widest = WIDTHS[0][0]
+    for name in ("hidden", "head_dim", "max_tokens"):
+        if getattr(args, name) <= 0 or getattr(args, name) % widest:
+            ap.error(f"--{name.replace('_', '-')} must be a positive multiple of {widest}")
+
+    with open(args.output, "w") as f:
+        f.write(generate(args.hidden, args.head_dim, args.max_tokens))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,269 @@
+"""TBF2 writer and TBF1 -> TBF2 converter.
+
+TBF2 layout (little-endian, see src/main/c/tbf.h):
+
+    "TBF2" u32 data_start, u64 count, u32 n_meta, u32 index_slots
+    n_meta x (u16 key_len, key, i64 value)
+    count  x (u16 name_len, name, u8 dtype, u8 ndim, u32 dims[ndim], u64 offset, u64 nbytes, u32 crc32)
+    index_slots x u32    FNV-1a(name) & (index_slots - 1), linear probing, tensor index + 1
+    payloads, each 64-byte aligned
+
+Usage:
+    python scripts/tbf2.py convert bert_weights.tbf bert_weights2.tbf [--heads 12] [--f16] [--q8-embeddings]
+    python scripts/tbf2.py info bert_weights2.tbf
+"""
+
+import argparse
+import re
+import struct
+import sys
+import zlib
+
+ALIGN = 64
+DTYPE_ITEMSIZE = {1: 4, 2: 2, 3: 8, 4: 8, 5: 4, 6: 1, 7: 1}
+WORD_EMBEDDINGS = "embeddings.word_embeddings.weight"
+
+
+def align_up(x, a=ALIGN):
+    return (x + a - 1) // a * a
+
+
+def fnv1a(name):
+    h = 2166136261
+    for b in name:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def read_tbf1(path):
+    """[(name, dtype, shape, payload bytes)] in file order"""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"TBF1":
+        raise ValueError(f"{path}: not a TBF1 file")
+    (count,) = struct.unpack_from("<Q", data, 4)
+    pos, tensors = 12, []
+    for _ in range(count):
+        (name_len,) = struct.unpack_from("<H", data, pos)
+        name = data[pos + 2 : pos + 2 + name_len].decode("utf-8")
+        pos += 2 + name_len
+        dtype, ndim = data[pos], data[pos + 1]
+        pos += 2
+        shape = struct.unpack_from(f"<{ndim}I", data, pos)
+        pos += 4 * ndim
+        offset, nbytes = struct.unpack_from("<QQ", data, pos)
+        pos += 16
+        if offset + nbytes > len(data):
+            raise ValueError(f"{path}: payload of {name} runs past the end of the file")
+        tensors.append((name, dtype, tuple(shape), data[offset : offset + nbytes]))
+    return tensors
+
+
+def to_f16(tensors):
+    """Store every 2-D float32 tensor (linear weights, embedding tables) as float16.
+
+    The runtime keeps linear weights and the word embeddings in FP16 and widens them on the
+    fly; biases and LayerNorm parameters stay float32.
+    """
+    out = []
+    for name, dtype, shape, payload in tensors:
+        if dtype == 1 and len(shape) == 2:
+            n = len(payload) // 4
+            payload = struct.pack(f"<{n}e", *struct.unpack(f"<{n}f", payload))
+            dtype = 2
+        out.append((name, dtype, shape, payload))
+    return out
+
+
+def q8_rows(values, rows, cols):
+    """Symmetric int8 per row: (int8 payload, float32 scales payload)"""
+    q, scales = bytearray(rows * cols), []
+    for r in range(rows):
+        row = values[r * cols : (r + 1) * cols]
+        amax = max(abs(v) for v in row)
+        scales.append(amax / 127.0)
+        inv = 127.0 / amax if amax > 0 else 0.0
+        q[r * cols : (r + 1) * cols] = struct.pack(f"<{cols}b", *(round(v * inv) for v in row))
+    return bytes(q), struct.pack(f"<{rows}f", *scales)
+
+
+def q8_embeddings(tensors):
+    """Store the word embedding table as int8 with one float32 scale per row.
+
+    The table is most of the model; the runtime dequantizes only the gathered rows. The
+    scales go to a float32 tensor named WORD_EMBEDDINGS + "_scale".
+    """
+    out = []
+    for name, dtype, shape, payload in tensors:
+        if name == WORD_EMBEDDINGS and dtype in (1, 2):
+            n = shape[0] * shape[1]
+            values = struct.unpack(f"<{n}{'f' if dtype == 1 else 'e'}", payload)
+            q, scales = q8_rows(values, shape[0], shape[1])
+            out.append((name, 7, shape, q))
+            out.append((name + "_scale", 1, (shape[0],), scales))
+            continue
+        out.append((name, dtype, shape, payload))
+    return out
+
+
+def infer_meta(tensors, n_heads):
+    """BERT hyperparameters from tensor names and shapes"""
+    shapes = {name: shape for name, _, shape, _ in tensors}
+    layers = {int(m.group(1)) for n in shapes if (m := re.match(r"encoder\.layer\.(\d+)\.", n))}
+    word = shapes["embeddings.word_embeddings.weight"]
+    return {
+        "n_layers": len(layers),
+        "n_heads": n_heads,
+        "hidden_size": word[1],
+        "intermediate_size": shapes["encoder.layer.0.intermediate.dense.weight"][0],
+        "vocab_size": word[0],
+        "max_positions": shapes["embeddings.position_embeddings.weight"][0],
+    }
+
+
+def write_tbf2(path, tensors, meta):
+    """tensors: [(name, dtype, shape, payload bytes)], meta: {key: int}"""
+    names = [name.encode("utf-8") for name, _, _, _ in tensors]
+    for (name, dtype, shape, payload), raw in zip(tensors, names):
+        expected = DTYPE_ITEMSIZE[dtype]
+        for d in shape:
+            expected *= d
+        if expected != len(payload):
+            raise ValueError(f"{name}: {len(payload)} bytes for shape {shape}")
+        if len(raw) >= 128 or len(shape) > 4:
+            raise ValueError(f"{name}: name too long or rank above 4")
+
+    slots = 16
+    while slots < 2 * len(tensors):
+        slots *= 2
+    index = [0] * slots
+    for i, raw in enumerate(names):
+        s = fnv1a(raw) & (slots - 1)
+        while index[s]:
+            s = (s + 1) & (slots - 1)
+        index[s] = i + 1
+
+    meta_block = b"".join(
+        struct.pack("<H", len(k.encode())) + k.encode() + struct.pack("<q", v) for k, v in meta.items()
+    )
+    header_size = 4 + 4 + 8 + 4 + 4 + len(meta_block)
+    header_size += sum(2 + len(raw) + 2 + 4 * len(shape) + 8 + 8 + 4 for raw, (_, _, shape, _) in zip(names, tensors))
+    header_size += 4 * slots
+    data_start = align_up(header_size)
+
+    offsets, offset = [], data_start
+    for _, _, _, payload in tensors:
+        offsets.append(offset)
+        offset = align_up(offset + len(payload))
+
+    with open(path, "wb") as f:
+        f.write(b"TBF2")
+        f.write(struct.pack("<IQII", data_start, len(tensors), len(meta), slots))
+        f.write(meta_block)
+        for raw, (_, dtype, shape, payload), off in zip(names, tensors, offsets):
+            f.write(struct.pack("<H", len(raw)) + raw)
+            f.write(struct.pack("<BB", dtype, len(shape)))
+            f.write(struct.pack(f"<{len(shape)}I", *shape))
+            f.write(struct.pack("<QQI", off, len(payload), zlib.crc32(payload) & 0xFFFFFFFF))
+        f.write(struct.pack(f"<{slots}I", *index))
+        for (_, _, _, payload), off in zip(tensors, offsets):
+            f.write(b"\0" * (off - f.tell()))
+            f.write(payload)
+
+
+def dump_tbf2(model, path, f16=False, q8_embeddings=False):
+    """Write a Hugging Face BERT model straight to TBF2; f16 stores 2-D weights as float16,
+    q8_embeddings the word embedding table as int8 with per-row scales"""
+    import torch
+
+    dtypes = {
+        torch.float32: 1, torch.float16: 2, torch.float64: 3, torch.int64: 4, torch.int32: 5, torch.uint8: 6,
+        torch.int8: 7,
+    }
+    tensors = []
+    for name, p in model.named_parameters():
+        p = p.detach().cpu()
+        if q8_embeddings and name == WORD_EMBEDDINGS:
+            scale = p.abs().amax(dim=1, keepdim=True) / 127.0
+            q = torch.where(scale > 0, torch.round(p / scale), torch.zeros_like(p)).to(torch.int8)
+            tensors.append((name, 7, tuple(q.shape), q.contiguous().numpy().tobytes(order="C")))
+            scale = scale.squeeze(1).float().contiguous().numpy()
+            tensors.append((name + "_scale", 1, scale.shape, scale.tobytes(order="C")))
+            continue
+        if f16 and p.dtype == torch.float32 and p.dim() == 2:
+            p = p.half()
+        arr = p.contiguous().numpy()
+        tensors.append((name, dtypes[p.dtype], arr.shape, arr.tobytes(order="C")))
+    cfg = model.config
+    write_tbf2(
+        path,
+        tensors,
+        {
+            "n_layers": cfg.num_hidden_layers,
+            "n_heads": cfg.num_attention_heads,
+            "hidden_size": cfg.hidden_size,
+            "intermediate_size": cfg.intermediate_size,
+            "vocab_size": cfg.vocab_size,
+            "max_positions": cfg.max_position_embeddings,
+        },
+    )
+
+
+def info(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"TBF2":
+        raise ValueError(f"{path}: not a TBF2 file")
+    data_start, count, n_meta, slots = struct.unpack_from("<IQII", data, 4)
+    pos = 24
+    for _ in range(n_meta):
+        (key_len,) = struct.unpack_from("<H", data, pos)
+        key = data[pos + 2 : pos + 2 + key_len].decode()
+        (value,) = struct.unpack_from("<q", data, pos + 2 + key_len)
+        pos += 2 + key_len + 8
+        print(f"{key:20} {value}")
+    bad = 0
+    for _ in range(count):
+        (name_len,) = struct.unpack_from("<H", data, pos)
+        name = data[pos + 2 : pos + 2 + name_len].decode()
+        pos += 2 + name_len
+        dtype, ndim = data[pos], data[pos + 1]
+        shape = struct.unpack_from(f"<{ndim}I", data, pos + 2)
+        pos += 2 + 4 * ndim
+        offset, nbytes, crc = struct.unpack_from("<QQI", data, pos)
+        pos += 20
+        ok = zlib.crc32(data[offset : offset + nbytes]) & 0xFFFFFFFF == crc
+        bad += not ok
+        print(f"{name:50} dtype={dtype} shape={shape} offset={offset} {'ok' if ok else 'CHECKSUM MISMATCH'}")
+    print(f"{count} tensors, data at {data_start}, {slots} index slots")
+    return bad == 0
+
+
+def main(argv):
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = ap.add_subparsers(dest="cmd", required=True)
+    conv = sub.add_parser("convert", help="convert a TBF1 file to TBF2")
+    conv.add_argument("src")
+    conv.add_argument("dst")
+    conv.add_argument("--heads", type=int, default=12, help="attention heads (not recoverable from TBF1)")
+    conv.add_argument("--f16", action="store_true", help="store linear weights and embedding tables as float16")
+    conv.add_argument(
+        "--q8-embeddings", action="store_true", help="store the word embedding table as int8 with per-row scales"
+    )
+    inf = sub.add_parser("info", help="print metadata and verify checksums of a TBF2 file")
+    inf.add_argument("path")
+    args = ap.parse_args(argv)
+
+    if args.cmd == "convert":
+        tensors = read_tbf1(args.src)
+        if args.q8_embeddings:
+            tensors = q8_embeddings(tensors)
+        if args.f16:
+            tensors = to_f16(tensors)
+        write_tbf2(args.dst, tensors, infer_meta(tensors, args.heads))
+        return 0
+    return 0 if info(args.path) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
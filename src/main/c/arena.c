@@ -0,0 +1,58 @@
+// arena.c — bump allocator for per-call activations
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 64
+
+t_status arena_init(arena_t *a, size_t cap)
+{
+    cap = arena_footprint(cap);
+    a->base = (uint8_t *)aligned_alloc(ARENA_ALIGN, cap ? cap : ARENA_ALIGN);
+    a->cap = a->base ? cap : 0;
+    a->used = 0;
+    return a->base ? T_OK : T_ERR;
+}
+
+void arena_destroy(arena_t *a)
+{
+    free(a->base);
+    *a = (arena_t){0};
+}
+
+size_t arena_footprint(size_t bytes)
+{
+    return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void *arena_alloc(arena_t *a, size_t bytes)
+{
+    const size_t size = arena_footprint(bytes);
+    if (size > a->cap - a->used)
+        return NULL;
+    void *p = a->base + a->used;
+    a->used += size;
+    return p;
+}
+
+t_status arena_tensor(arena_t *a, tensor_t *out, uint32_t ndim, const uint32_t *dims)
+{
+    size_t numel = 1;
+    for (uint32_t i = 0; i < ndim; i++)
+        numel *= dims[i];
+    float *data = (float *)arena_alloc(a, numel * sizeof(float));
+    if (!data)
+        return T_ERR;
+
+    *out = (tensor_t){0};
+    out->ndim = ndim;
+    out->data = data;
+    memcpy(out->dims, dims, ndim * sizeof(uint32_t));
+    uint64_t s = 1;
+    for (int i = (int)ndim - 1; i >= 0; --i)
+    {
+        out->strides[i] = s;
+        s *= dims[i];
+    }
+    return T_OK;
+}
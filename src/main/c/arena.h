@@ -0,0 +1,37 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "tbf.h"
+
+/// Bump allocator for activations.
+///
+/// One block is allocated up front; arena_alloc hands out 64-byte aligned slices of it
+/// and never frees them individually. arena_mark / arena_rewind release everything
+/// allocated after a mark, arena_reset releases everything. Not thread-safe: an arena
+/// belongs to one call at a time.
+typedef struct arena_t
+{
+    uint8_t *base;
+    size_t cap;
+    size_t used;
+} arena_t;
+
+/// @brief Allocate the backing block of `cap` bytes
+t_status arena_init(arena_t *a, size_t cap);
+
+/// @brief Free the backing block. A zeroed arena is allowed.
+void arena_destroy(arena_t *a);
+
+/// @brief `bytes` bytes, 64-byte aligned, uninitialized; NULL when the arena is full
+void *arena_alloc(arena_t *a, size_t bytes);
+
+/// @brief Bytes arena_alloc consumes for a request of `bytes`, alignment included
+size_t arena_footprint(size_t bytes);
+
+static inline size_t arena_mark(const arena_t *a) { return a->used; }
+static inline void arena_rewind(arena_t *a, size_t mark) { a->used = mark; }
+static inline void arena_reset(arena_t *a) { a->used = 0; }
+
+/// @brief Contiguous row-major tensor backed by the arena, uninitialized
+/// @return T_ERR when the arena is full; the tensor must not be passed to tensor_destroy
+t_status arena_tensor(arena_t *a, tensor_t *out, uint32_t ndim, const uint32_t *dims);
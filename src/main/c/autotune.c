@@ -0,0 +1,335 @@
+// autotune.c — startup GEMM autotuner with a per-CPU-model cache
+#define _POSIX_C_SOURCE 200809L
+#include "autotune.h"
+#include "kernels.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define AUTOTUNE_VERSION 1
+// a candidate replaces the current choice only when it is at least this much faster
+#define AUTOTUNE_MARGIN 0.97
+#define AUTOTUNE_REPEATS 3
+// cache file path: the directory (at most 1023 bytes) and the file name
+#define AUTOTUNE_PATH_MAX 1100
+
+static const size_t tune_mc[] = {GEMM_MC, 48, 144, 192};
+static const size_t tune_kc[] = {GEMM_KC, 128, 192, 384};
+
+static const char *const weights_names[] = {"f32", "f16", "i8"};
+
+// ---- Timing ----
+
+typedef struct
+{
+    size_t M;
+    size_t n_shapes;
+    const autotune_shape_t *shapes;
+    autotune_weights_t weights;
+    float *A;   // [M, max K]
+    float *C;   // [M, max N]
+    void **B;   // per shape: packed panels
+    float **b_scale;
+    int32_t **b_sum;
+    void *scratch; // GEMM packing buffers, single-threaded
+} bench_t;
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// one pass over every shape; the first call of a candidate also warms its code and buffers
+static double bench_pass(const bench_t *b)
+{
+    const double t0 = now_s();
+    for (size_t s = 0; s < b->n_shapes; s++)
+    {
+        const size_t K = b->shapes[s].K, N = b->shapes[s].N;
+        if (b->weights == AUTOTUNE_F32)
+            gemm_packed(b->M, N, K, b->A, K, (const float *)b->B[s], b->C, N, NULL, b->scratch, NULL);
+        else if (b->weights == AUTOTUNE_F16)
+            gemm_packed_f16(b->M, N, K, b->A, K, (const uint16_t *)b->B[s], b->C, N, NULL, b->scratch, NULL);
+        else
+            gemm_packed_i8(b->M, N, K, b->A, K, (const int8_t *)b->B[s], b->b_scale[s], b->b_sum[s], b->C, N, NULL,
+                           b->scratch, NULL);
+    }
+    return now_s() - t0;
+}
+
+static double bench_best(const bench_t *b)
+{
+    bench_pass(b);
+    double best = bench_pass(b);
+    for (int r = 1; r < AUTOTUNE_REPEATS; r++)
+    {
+        const double t = bench_pass(b);
+        best = t < best ? t : best;
+    }
+    return best;
+}
+
+static void bench_free(bench_t *b)
+{
+    for (size_t s = 0; b->B && s < b->n_shapes; s++)
+    {
+        free(b->B[s]);
+        if (b->b_scale)
+            free(b->b_scale[s]);
+        if (b->b_sum)
+            free(b->b_sum[s]);
+    }
+    free(b->B);
+    free(b->b_scale);
+    free(b->b_sum);
+    free(b->A);
+    free(b->C);
+    free(b->scratch);
+}
+
+// Random operands of the right sizes; the values only need to be ordinary numbers.
+static bool bench_init(bench_t *b)
+{
+    size_t max_k = 0, max_n = 0;
+    for (size_t s = 0; s < b->n_shapes; s++)
+    {
+        max_k = b->shapes[s].K > max_k ? b->shapes[s].K : max_k;
+        max_n = b->shapes[s].N > max_n ? b->shapes[s].N : max_n;
+        if (b->weights == AUTOTUNE_I8 && b->shapes[s].K > GEMM_I8_KMAX)
+            return false;
+    }
+    b->A = (float *)malloc(b->M * max_k * sizeof(float));
+    b->C = (float *)malloc(b->M * max_n * sizeof(float));
+    b->B = (void **)calloc(b->n_shapes, sizeof(void *));
+    b->b_scale = (float **)calloc(b->n_shapes, sizeof(float *));
+    b->b_sum = (int32_t **)calloc(b->n_shapes, sizeof(int32_t *));
+    b->scratch = aligned_alloc(64, gemm_scratch_size(1));
+    float *w = (float *)malloc(max_k * max_n * sizeof(float));
+    uint16_t *w16 = (uint16_t *)malloc(max_k * max_n * sizeof(uint16_t));
+    if (!b->A || !b->C || !b->B || !b->b_scale || !b->b_sum || !b->scratch || !w || !w16)
+        goto fail;
+
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < b->M * max_k; i++)
+        b->A[i] = (float)((seed = seed * 1664525u + 1013904223u) >> 8) * 0x1p-24f - 0.5f;
+    for (size_t i = 0; i < max_k * max_n; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        w[i] = (float)(seed >> 8) * 0x1p-24f - 0.5f;
+        w16[i] = (uint16_t)((seed & 0x8000) | (0x2000 + (seed >> 16) % 0x1800)); // about +-(0, 0.5)
+    }
+
+    for (size_t s = 0; s < b->n_shapes; s++)
+    {
+        const size_t K = b->shapes[s].K, N = b->shapes[s].N;
+        const size_t panels = (N + GEMM_NR - 1) / GEMM_NR;
+        // W is [N, K], the linear weight layout
+        if (b->weights == AUTOTUNE_F32)
+        {
+            float *p = (float *)aligned_alloc(64, gemm_packed_b_size(K, N) * sizeof(float));
+            if (!(b->B[s] = p))
+                goto fail;
+            gemm_pack_b(p, w, K, N, K, true);
+        }
+        else if (b->weights == AUTOTUNE_F16)
+        {
+            uint16_t *p = (uint16_t *)aligned_alloc(64, gemm_packed_b_size(K, N) * sizeof(float));
+            if (!(b->B[s] = p))
+                goto fail;
+            gemm_pack_b_f16(p, w16, K, N, K, true);
+        }
+        else
+        {
+            int8_t *p = (int8_t *)aligned_alloc(64, gemm_packed_b_i8_size(K, N));
+            b->B[s] = p;
+            b->b_scale[s] = (float *)malloc(N * sizeof(float));
+            b->b_sum[s] = (int32_t *)aligned_alloc(64, panels * GEMM_NR * sizeof(int32_t));
+            if (!p || !b->b_scale[s] || !b->b_sum[s])
+                goto fail;
+            gemm_quantize_b(p, b->b_scale[s], b->b_sum[s], w, K, N, K);
+        }
+    }
+    free(w);
+    free(w16);
+    return true;
+
+fail:
+    free(w);
+    free(w16);
+    return false;
+}
+
+// ---- Cache file ----
+
+static uint32_t fnv1a(const char *s)
+{
+    uint32_t h = 2166136261u;
+    for (; *s; s++)
+        h = (h ^ (uint8_t)*s) * 16777619u;
+    return h;
+}
+
+// mkdir -p; false if the directory does not exist afterwards
+static bool make_dirs(const char *dir)
+{
+    char path[1024];
+    if (snprintf(path, sizeof(path), "%s", dir) >= (int)sizeof(path))
+        return false;
+    for (char *p = path + 1; *p; p++)
+        if (*p == '/')
+        {
+            *p = '\0';
+            if (mkdir(path, 0755) != 0 && errno != EEXIST)
+                return false;
+            *p = '/';
+        }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+static bool cache_dir_default(char *dir, size_t n)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    if (xdg && *xdg)
+        return snprintf(dir, n, "%s/minilm", xdg) < (int)n;
+    if (home && *home)
+        return snprintf(dir, n, "%s/.cache/minilm", home) < (int)n;
+    return false;
+}
+
+static bool cache_read(const char *path, const char *cpu, autotune_result_t *res)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[256];
+    int version = 0, fields = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "minilm-autotune %d", &version) == 1)
+            fields |= 1;
+        else if (strncmp(line, "cpu ", 4) == 0)
+            fields |= strcmp(line + 4, cpu) == 0 ? 2 : 0;
+        else if (sscanf(line, "isa %15s", res->isa) == 1)
+            fields |= 4;
+        else if (sscanf(line, "mc %zu", &res->tiling.mc) == 1)
+            fields |= 8;
+        else if (sscanf(line, "kc %zu", &res->tiling.kc) == 1)
+            fields |= 16;
+    }
+    fclose(f);
+    return fields == 31 && version == AUTOTUNE_VERSION;
+}
+
+// written to a temporary file and renamed, so concurrent starts never read half a file
+static bool cache_write(const char *path, const char *cpu, const autotune_result_t *res)
+{
+    char tmp[AUTOTUNE_PATH_MAX + 24]; // path + "." + a pid
+    if (snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid()) >= (int)sizeof(tmp))
+        return false;
+    FILE *f = fopen(tmp, "w");
+    if (!f)
+        return false;
+    fprintf(f, "minilm-autotune %d\ncpu %s\nisa %s\nmc %zu\nkc %zu\n",
+            AUTOTUNE_VERSION, cpu, res->isa, res->tiling.mc, res->tiling.kc);
+    const bool ok = fclose(f) == 0 && rename(tmp, path) == 0;
+    if (!ok)
+        remove(tmp);
+    return ok;
+}
+
+// ---- Tuning ----
+
+static void tune(const bench_t *b, autotune_result_t *res)
+{
+    // kernel variants, best-first order so that ties keep the cpuid choice
+    const kernels_t *tables[8];
+    const size_t n_tables = kernels_supported(tables, 8);
+    const kernels_t *best_table = kernels_get();
+    if (n_tables > 1 && kernels_use(tables[0]->name))
+    {
+        double best = -1.0;
+        for (size_t i = 0; i < n_tables; i++)
+        {
+            kernels_use(tables[i]->name);
+            const double t = bench_best(b);
+            if (best < 0.0 || t < best * AUTOTUNE_MARGIN)
+            {
+                best = t;
+                best_table = tables[i];
+            }
+        }
+        kernels_use(best_table->name);
+    }
+    snprintf(res->isa, sizeof(res->isa), "%s", best_table->name);
+
+    // blocking of the float GEMMs on that variant, the default first
+    res->tiling = (gemm_tiling_t){GEMM_MC, GEMM_KC};
+    if (b->weights != AUTOTUNE_I8)
+    {
+        double best = -1.0;
+        for (size_t i = 0; i < sizeof(tune_mc) / sizeof(tune_mc[0]); i++)
+            for (size_t j = 0; j < sizeof(tune_kc) / sizeof(tune_kc[0]); j++)
+            {
+                const gemm_tiling_t t = {tune_mc[i], tune_kc[j]};
+                gemm_set_tiling(t);
+                const double dt = bench_best(b);
+                if (best < 0.0 || dt < best * AUTOTUNE_MARGIN)
+                {
+                    best = dt;
+                    res->tiling = t;
+                }
+            }
+    }
+    gemm_set_tiling(res->tiling);
+}
+
+bool autotune_gemm(const autotune_shape_t *shapes, size_t n_shapes, size_t M, autotune_weights_t weights,
+                   const char *cache_dir, bool force, autotune_result_t *out)
+{
+    autotune_result_t res = {0};
+    char cpu[64], dir[1024], path[AUTOTUNE_PATH_MAX];
+    kernels_cpu_name(cpu, sizeof(cpu));
+    // cpuid brand strings are ASCII without newlines; anything else would break the file format
+    for (char *c = cpu; *c; c++)
+        if (*c < ' ' || *c > '~')
+            *c = '?';
+
+    bool have_path = cache_dir ? snprintf(dir, sizeof(dir), "%s", cache_dir) < (int)sizeof(dir)
+                               : cache_dir_default(dir, sizeof(dir));
+    if (have_path)
+        snprintf(path, sizeof(path), "%s/gemm-%08x-%s.tune", dir, fnv1a(cpu), weights_names[weights]);
+
+    if (have_path && !force && cache_read(path, cpu, &res) && gemm_set_tiling(res.tiling))
+    {
+        // a variant this process cannot use (MINILM_ISA, another build) keeps the current one
+        if (!kernels_use(res.isa))
+            snprintf(res.isa, sizeof(res.isa), "%s", kernels_get()->name);
+        res.cached = true;
+        if (out)
+            *out = res;
+        return true;
+    }
+
+    bench_t b = {.M = M, .n_shapes = n_shapes, .shapes = shapes, .weights = weights};
+    if (n_shapes == 0 || M == 0 || !bench_init(&b))
+    {
+        bench_free(&b);
+        return false;
+    }
+    tune(&b, &res);
+    bench_free(&b);
+
+    if (!have_path || !make_dirs(dir) || !cache_write(path, cpu, &res))
+        fprintf(stderr, "[minilm] could not write the autotune cache %s\n", have_path ? path : "(no cache directory)");
+    if (out)
+        *out = res;
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include "gemm.h"
+
+/// Startup autotuner for the GEMM.
+///
+/// Times the model's linear layer shapes on every kernel variant this CPU supports, then
+/// the gemm_tiling_t candidates on the fastest variant, and applies the winner through
+/// kernels_use and gemm_set_tiling. A candidate has to beat the current choice by a few
+/// percent, so timing noise falls back to the cpuid order and the default blocking.
+/// Products run single-threaded: the blocking is about one core's caches.
+///
+/// The choice is cached in a small text file per CPU model (cpuid brand string) and weight
+/// type, so later starts on the same kind of machine only read it. Tuning takes about a
+/// second on an SSE4.2-only machine and a fraction of that with AVX2 or AVX-512.
+
+/// @brief Which GEMM the model's linear layers run
+typedef enum autotune_weights_t
+{
+    AUTOTUNE_F32, // gemm_packed
+    AUTOTUNE_F16, // gemm_packed_f16
+    AUTOTUNE_I8,  // gemm_packed_i8; its blocking is fixed, only the variant is tuned
+} autotune_weights_t;
+
+/// @brief One linear layer, C[M, N] = A[M, K] x B[K, N]
+typedef struct autotune_shape_t
+{
+    size_t K, N;
+} autotune_shape_t;
+
+typedef struct autotune_result_t
+{
+    char isa[16];         // kernels_t name
+    gemm_tiling_t tiling; // gemm_get_tiling after tuning
+    bool cached;          // read from the cache file, nothing was timed
+} autotune_result_t;
+
+/// @brief Apply the cached choice for this CPU model, or tune and cache it
+/// @param M rows of the timed products (tokens per batch)
+/// @param cache_dir where the cache files live, created if missing;
+///                  NULL = $XDG_CACHE_HOME/minilm, else $HOME/.cache/minilm
+/// @param force tune even if there is a cached choice, and overwrite it
+/// @param out what was applied, may be NULL
+/// @return false if tuning could not run (allocation); a cache file that cannot be written
+///         is reported on stderr, the tuned choice still applies
+bool autotune_gemm(const autotune_shape_t *shapes, size_t n_shapes, size_t M, autotune_weights_t weights,
+                   const char *cache_dir, bool force, autotune_result_t *out);
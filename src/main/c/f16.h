@@ -0,0 +1,31 @@
+#pragma once
+#include <stdint.h>
+
+/// IEEE 754 half precision (FP16) storage for weights.
+///
+/// Weight files may hold float16 tensors (TBF dtype 2). Linear weights stay in FP16 and
+/// are widened inside the GEMM microkernel (gemm_packed_f16); everything else is widened
+/// once at load time. The vector kernels use F16C; this is the portable scalar form.
+
+/// @brief Exact FP16 -> FP32 conversion, including subnormals and infinities.
+/// NaNs come out quiet with their payload kept, as with F16C (vcvtph2ps).
+static inline float f16_to_f32(uint16_t h)
+{
+    const uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+    const uint32_t exp = (h >> 10) & 0x1fu, man = h & 0x3ffu;
+    union
+    {
+        uint32_t u;
+        float f;
+    } v;
+    if (exp == 0x1f)
+        v.u = sign | 0x7f800000u | (man ? 0x400000u : 0) | (man << 13);
+    else if (exp != 0)
+        v.u = sign | ((exp + 112) << 23) | (man << 13); // rebias 15 -> 127
+    else
+    {
+        v.f = (float)man * 0x1p-24f; // zero and subnormals
+        v.u |= sign;
+    }
+    return v.f;
+}
@@ -0,0 +1,625 @@
+// gemm.c — packed-panel SGEMM with register-blocked microkernels
+#include "gemm.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <stdatomic.h>
+#include "kernels.h"
+
+#define m_min(a, b) ((a) < (b) ? (a) : (b))
+#define m_max(a, b) ((a) > (b) ? (a) : (b))
+
+_Static_assert(GEMM_NC % GEMM_NR == 0, "GEMM_NC must be whole column panels");
+_Static_assert(GEMM_MC <= GEMM_MC_MAX && GEMM_KC <= GEMM_KC_MAX, "default tiling above its maximum");
+
+// ---- Tiling ----
+
+static atomic_size_t tiling_mc = GEMM_MC, tiling_kc = GEMM_KC;
+
+bool gemm_set_tiling(gemm_tiling_t t)
+{
+    if (t.mc == 0 || t.mc > GEMM_MC_MAX || t.kc == 0 || t.kc > GEMM_KC_MAX)
+        return false;
+    atomic_store_explicit(&tiling_mc, t.mc, memory_order_relaxed);
+    atomic_store_explicit(&tiling_kc, t.kc, memory_order_relaxed);
+    return true;
+}
+
+gemm_tiling_t gemm_get_tiling(void)
+{
+    return (gemm_tiling_t){
+        .mc = atomic_load_explicit(&tiling_mc, memory_order_relaxed),
+        .kc = atomic_load_explicit(&tiling_kc, memory_order_relaxed),
+    };
+}
+
+// ---- Packing ----
+
+size_t gemm_packed_b_size(size_t K, size_t N)
+{
+    return ((N + GEMM_NR - 1) / GEMM_NR) * K * GEMM_NR;
+}
+
+// Same layout for every element type; only the load-time pack exists per type
+#define GEMM_PACK_B(name, T)                                                           \
+    void name(T *dst, const T *src, size_t K, size_t N, size_t ldb, bool trans)        \
+    {                                                                                  \
+        const size_t panels = (N + GEMM_NR - 1) / GEMM_NR;                             \
+        for (size_t jp = 0; jp < panels; ++jp)                                         \
+        {                                                                              \
+            T *panel = dst + jp * K * GEMM_NR;                                         \
+            const size_t j0 = jp * GEMM_NR;                                            \
+            const size_t nc = m_min(GEMM_NR, N - j0);                                  \
+            if (trans)                                                                 \
+            {                                                                          \
+                /* src is B^T: each of its rows is one column of B */                  \
+                for (size_t jj = 0; jj < GEMM_NR; ++jj)                                \
+                {                                                                      \
+                    const T *col = src + (j0 + jj) * ldb;                              \
+                    for (size_t k = 0; k < K; ++k)                                     \
+                        panel[k * GEMM_NR + jj] = (jj < nc) ? col[k] : (T)0;           \
+                }                                                                      \
+            }                                                                          \
+            else                                                                       \
+            {                                                                          \
+                for (size_t k = 0; k < K; ++k)                                         \
+                {                                                                      \
+                    T *dst_row = panel + k * GEMM_NR;                                  \
+                    memcpy(dst_row, src + k * ldb + j0, nc * sizeof(T));               \
+                    memset(dst_row + nc, 0, (GEMM_NR - nc) * sizeof(T));               \
+                }                                                                      \
+            }                                                                          \
+        }                                                                              \
+    }
+
+GEMM_PACK_B(gemm_pack_b, float)
+GEMM_PACK_B(gemm_pack_b_f16, uint16_t) // FP16 +0.0 is all zero bits
+
+size_t gemm_packed_b_i8_size(size_t K, size_t N)
+{
+    return ((N + GEMM_NR - 1) / GEMM_NR) * ((K + 3) & ~(size_t)3) * GEMM_NR;
+}
+
+// Symmetric int8 quantization of n values: returns the scale, writes q = round(x / scale)
+static float gemm_quantize_row(int8_t *q, size_t q_stride, const float *x, size_t n)
+{
+    float amax = 0.0f;
+    for (size_t k = 0; k < n; ++k)
+        amax = fmaxf(amax, fabsf(x[k]));
+    const float scale = amax / 127.0f;
+    const float inv = amax > 0.0f ? 127.0f / amax : 0.0f;
+    for (size_t k = 0; k < n; ++k)
+        q[(k / 4) * q_stride + k % 4] = (int8_t)rintf(x[k] * inv);
+    return scale;
+}
+
+void gemm_quantize_b(int8_t *dst, float *scale, int32_t *sum, const float *w, size_t K, size_t N, size_t ldw)
+{
+    const size_t K4 = (K + 3) & ~(size_t)3;
+    const size_t panels = (N + GEMM_NR - 1) / GEMM_NR;
+    memset(dst, 0, gemm_packed_b_i8_size(K, N));
+    for (size_t jp = 0; jp < panels; ++jp)
+    {
+        int8_t *panel = dst + jp * K4 * GEMM_NR;
+        for (size_t jj = 0; jj < GEMM_NR; ++jj)
+        {
+            const size_t n = jp * GEMM_NR + jj;
+            int32_t s = 0;
+            if (n < N)
+            {
+                scale[n] = gemm_quantize_row(panel + 4 * jj, 4 * GEMM_NR, w + n * ldw, K);
+                for (size_t k = 0; k < K; ++k)
+                    s += panel[(k / 4) * 4 * GEMM_NR + 4 * jj + k % 4];
+            }
+            sum[n] = s;
+        }
+    }
+}
+
+// A[mc, K] -> ceil(mc / MR) micro-panels of [K4 / 4, MR, 4] int8, one scale per row;
+// rows past mc are zero
+static void gemm_quantize_a(int8_t *__restrict dst, float *__restrict scale, const float *__restrict A, size_t lda,
+                            size_t mc, size_t K, size_t MR)
+{
+    const size_t K4 = (K + 3) & ~(size_t)3;
+    for (size_t i0 = 0; i0 < mc; i0 += MR)
+    {
+        int8_t *panel = dst + i0 * K4;
+        memset(panel, 0, MR * K4);
+        for (size_t i = 0; i < MR && i0 + i < mc; ++i)
+            scale[i0 + i] = gemm_quantize_row(panel + 4 * i, 4 * MR, A + (i0 + i) * lda, K);
+    }
+}
+
+// A[mc, kc] -> ceil(mc / MR) micro-panels of [kc, MR], zero-padding the last one
+static void gemm_pack_a(float *__restrict dst, const float *__restrict A, size_t lda, size_t mc, size_t kc, size_t MR)
+{
+    for (size_t i0 = 0; i0 < mc; i0 += MR)
+    {
+        const size_t mr = m_min(MR, mc - i0);
+        for (size_t k = 0; k < kc; ++k)
+        {
+            size_t i = 0;
+            for (; i < mr; ++i)
+                dst[i] = A[(i0 + i) * lda + k];
+            for (; i < MR; ++i)
+                dst[i] = 0.0f;
+            dst += MR;
+        }
+    }
+}
+
+// gemm_pack_a from A^T[kc, mc] (row stride lda): each micro-panel row is a contiguous read
+static void gemm_pack_a_trans(float *__restrict dst, const float *__restrict At, size_t lda, size_t mc, size_t kc,
+                              size_t MR)
+{
+    for (size_t i0 = 0; i0 < mc; i0 += MR)
+    {
+        const size_t mr = m_min(MR, mc - i0);
+        for (size_t k = 0; k < kc; ++k)
+        {
+            memcpy(dst, At + k * lda + i0, mr * sizeof(float));
+            memset(dst + mr, 0, (MR - mr) * sizeof(float));
+            dst += MR;
+        }
+    }
+}
+
+// ---- Epilogue ----
+
+// c[mr, nc] is the block of C at (row, col)
+static void gemm_epilogue_tile(const kernels_t *kern, const gemm_epilogue_t *epi,
+                               float *c, size_t ldc, size_t row, size_t col, size_t mr, size_t nc)
+{
+    for (size_t i = 0; i < mr; ++i)
+    {
+        float *__restrict c_row = c + i * ldc;
+        if (epi->bias)
+            for (size_t j = 0; j < nc; ++j)
+                c_row[j] += epi->bias[col + j];
+        if (epi->act == GEMM_ACT_GELU)
+            kern->gelu(c_row, nc);
+        else if (epi->act == GEMM_ACT_GELU_ERF)
+            kern->gelu_erf(c_row, nc);
+        if (epi->residual)
+        {
+            const float *__restrict r_row = epi->residual + (row + i) * epi->ld_residual + col;
+            for (size_t j = 0; j < nc; ++j)
+                c_row[j] += r_row[j];
+        }
+    }
+}
+
+// ---- Driver ----
+
+// One thread's packing buffers: the largest of gemm_task's A block, gemm_i8_task's
+// quantized A block and gemm_batched_task's A and B blocks. Each is a multiple of 64 bytes.
+#define GEMM_SCRATCH_F32 (GEMM_MC_MAX * GEMM_KC_MAX * sizeof(float))
+#define GEMM_SCRATCH_I8 (GEMM_MC * GEMM_I8_KMAX)
+#define GEMM_SCRATCH_BATCHED ((GEMM_MC * GEMM_KC + GEMM_KC * GEMM_NC) * sizeof(float))
+#define GEMM_SCRATCH_THREAD m_max(GEMM_SCRATCH_F32, m_max(GEMM_SCRATCH_I8, GEMM_SCRATCH_BATCHED))
+
+_Static_assert(GEMM_SCRATCH_THREAD % 64 == 0 && GEMM_MC * GEMM_KC * sizeof(float) % 64 == 0,
+               "per-thread packing buffers must stay 64-byte aligned");
+
+size_t gemm_scratch_size(size_t n_threads)
+{
+    return n_threads * GEMM_SCRATCH_THREAD;
+}
+
+// the calling thread's slice of a job's scratch
+static inline void *gemm_thread_scratch(uint8_t *scratch, const pool_t *pool)
+{
+    return scratch + pool_thread_index(pool) * GEMM_SCRATCH_THREAD;
+}
+
+typedef struct
+{
+    const kernels_t *kern;
+    size_t M, N, K;
+    const float *A;
+    size_t lda;
+    const float *B_packed;
+    const uint16_t *B_f16;  // FP16 panels instead of B_packed, see gemm_packed_f16
+    const int8_t *B_i8;     // gemm_packed_i8: quantized panels, column scales and sums
+    const float *b_scale;
+    const int32_t *b_sum;
+    bool skinny;            // gemm_skinny: M <= GEMM_SKINNY_MAX, one row block
+    float *C;
+    size_t ldc;
+    const gemm_epilogue_t *epi;
+    size_t mc, kc;          // blocking of A: gemm_get_tiling, GEMM_MC x all of K for int8
+    size_t panels;          // GEMM_NR-wide column panels of B
+    size_t chunk_panels;    // panels per task
+    size_t n_chunks;        // column chunks per row block
+    uint8_t *scratch;       // gemm_scratch_size(pool_size(pool)) bytes, see gemm_thread_scratch
+    const pool_t *pool;
+} gemm_job_t;
+
+static inline void gemm_ukernel_call(const gemm_job_t *job, size_t kc, const float *a, size_t b_off,
+                                     float *c, size_t ldc, bool accumulate)
+{
+    if (job->B_f16)
+        job->kern->gemm_ukernel_f16(kc, a, job->B_f16 + b_off, c, ldc, accumulate);
+    else
+        job->kern->gemm_ukernel(kc, a, job->B_packed + b_off, c, ldc, accumulate);
+}
+
+// One task: rows [ic, ic + job->mc) x panels [jp0, jp1) of C, all of K.
+static void gemm_task(void *arg, size_t task)
+{
+    const gemm_job_t *job = (const gemm_job_t *)arg;
+    const kernels_t *kern = job->kern;
+    const size_t MR = kern->gemm_mr;
+    const size_t ic = (task / job->n_chunks) * job->mc;
+    const size_t mc = m_min(job->mc, job->M - ic);
+    const size_t jp0 = (task % job->n_chunks) * job->chunk_panels;
+    const size_t jp1 = m_min(jp0 + job->chunk_panels, job->panels);
+    const size_t K = job->K, N = job->N, ldc = job->ldc;
+
+    // packed A block of this thread, reused by each of its tasks
+    float *a_buf = (float *)gemm_thread_scratch(job->scratch, job->pool);
+    _Alignas(64) float tile[GEMM_MR_MAX * GEMM_NR];
+
+    for (size_t pc = 0; pc < K; pc += job->kc)
+    {
+        const size_t kc = m_min(job->kc, K - pc);
+        const bool accumulate = pc > 0;
+        const gemm_epilogue_t *epi = pc + kc == K ? job->epi : NULL;
+        gemm_pack_a(a_buf, job->A + ic * job->lda + pc, job->lda, mc, kc, MR);
+
+        // One [kc, NR] micro-panel of B stays in L1 while all A micro-panels stream past it.
+        for (size_t jp = jp0; jp < jp1; ++jp)
+        {
+            const size_t b_off = jp * K * GEMM_NR + pc * GEMM_NR;
+            const size_t nc = m_min(GEMM_NR, N - jp * GEMM_NR);
+
+            for (size_t ir = 0; ir < mc; ir += MR)
+            {
+                const size_t mr = m_min(MR, mc - ir);
+                const float *a = a_buf + ir * kc;
+                float *c = job->C + (ic + ir) * ldc + jp * GEMM_NR;
+
+                if (mr == MR && nc == GEMM_NR)
+                {
+                    gemm_ukernel_call(job, kc, a, b_off, c, ldc, accumulate);
+                    if (epi)
+                        gemm_epilogue_tile(kern, epi, c, ldc, ic + ir, jp * GEMM_NR, mr, nc);
+                    continue;
+                }
+
+                // Edge tile: run the full kernel on a scratch tile, copy back the valid part.
+                if (accumulate)
+                    for (size_t i = 0; i < mr; ++i)
+                        memcpy(tile + i * GEMM_NR, c + i * ldc, nc * sizeof(float));
+                gemm_ukernel_call(job, kc, a, b_off, tile, GEMM_NR, accumulate);
+                for (size_t i = 0; i < mr; ++i)
+                    memcpy(c + i * ldc, tile + i * GEMM_NR, nc * sizeof(float));
+                if (epi)
+                    gemm_epilogue_tile(kern, epi, c, ldc, ic + ir, jp * GEMM_NR, mr, nc);
+            }
+        }
+    }
+}
+
+// One task of gemm_packed_i8: same split as gemm_task, all of K in one pass
+static void gemm_i8_task(void *arg, size_t task)
+{
+    const gemm_job_t *job = (const gemm_job_t *)arg;
+    const kernels_t *kern = job->kern;
+    const size_t MR = kern->gemm_mr;
+    const size_t ic = (task / job->n_chunks) * GEMM_MC;
+    const size_t mc = m_min(GEMM_MC, job->M - ic);
+    const size_t jp0 = (task % job->n_chunks) * job->chunk_panels;
+    const size_t jp1 = m_min(jp0 + job->chunk_panels, job->panels);
+    const size_t K4 = (job->K + 3) & ~(size_t)3, N = job->N, ldc = job->ldc;
+
+    // quantized A block of this thread, like gemm_task's a_buf
+    int8_t *a_buf = (int8_t *)gemm_thread_scratch(job->scratch, job->pool);
+    float a_scale[GEMM_MC];
+    _Alignas(64) int32_t tile[GEMM_MR_MAX * GEMM_NR];
+    gemm_quantize_a(a_buf, a_scale, job->A + ic * job->lda, job->lda, mc, job->K, MR);
+
+    for (size_t jp = jp0; jp < jp1; ++jp)
+    {
+        const int8_t *b = job->B_i8 + jp * K4 * GEMM_NR;
+        const size_t nc = m_min(GEMM_NR, N - jp * GEMM_NR);
+        const float *b_scale = job->b_scale + jp * GEMM_NR;
+
+        for (size_t ir = 0; ir < mc; ir += MR)
+        {
+            const size_t mr = m_min(MR, mc - ir);
+            float *c = job->C + (ic + ir) * ldc + jp * GEMM_NR;
+            kern->gemm_ukernel_i8(K4 / 4, a_buf + ir * K4, b, job->b_sum + jp * GEMM_NR, tile);
+            for (size_t i = 0; i < mr; ++i)
+            {
+                const float sa = a_scale[ir + i];
+                for (size_t j = 0; j < nc; ++j)
+                    c[i * ldc + j] = (float)tile[i * GEMM_NR + j] * (sa * b_scale[j]);
+            }
+            if (job->epi)
+                gemm_epilogue_tile(kern, job->epi, c, ldc, ic + ir, jp * GEMM_NR, mr, nc);
+        }
+    }
+}
+
+// One task of gemm_skinny: panels [jp0, jp1) of all M rows
+static void gemm_skinny_task(void *arg, size_t task)
+{
+    const gemm_job_t *job = (const gemm_job_t *)arg;
+    const kernels_t *kern = job->kern;
+    const size_t jp0 = task * job->chunk_panels;
+    const size_t jp1 = m_min(jp0 + job->chunk_panels, job->panels);
+    const size_t M = job->M, K = job->K, N = job->N, ldc = job->ldc;
+    _Alignas(64) float tile[GEMM_SKINNY_MAX * GEMM_NR];
+
+    for (size_t jp = jp0; jp < jp1; ++jp)
+    {
+        const size_t b_off = jp * K * GEMM_NR;
+        const size_t nc = m_min(GEMM_NR, N - jp * GEMM_NR);
+        float *c = job->C + jp * GEMM_NR;
+        // the tail panel goes through a scratch tile, like gemm_task's edge tiles
+        float *dst = nc == GEMM_NR ? c : tile;
+        const size_t ld = nc == GEMM_NR ? ldc : GEMM_NR;
+        if (job->B_f16)
+            kern->gemm_skinny_panel_f16(M, K, job->A, job->lda, job->B_f16 + b_off, dst, ld);
+        else
+            kern->gemm_skinny_panel(M, K, job->A, job->lda, job->B_packed + b_off, dst, ld);
+        if (dst == tile)
+            for (size_t i = 0; i < M; ++i)
+                memcpy(c + i * ldc, tile + i * GEMM_NR, nc * sizeof(float));
+        if (job->epi)
+            gemm_epilogue_tile(kern, job->epi, c, ldc, 0, jp * GEMM_NR, M, nc);
+    }
+}
+
+typedef struct
+{
+    const kernels_t *kern;
+    size_t M, N, K;
+    gemm_operand_t A, B;
+    float *C;
+    size_t ldc, stride_c;
+    size_t nc;           // columns per task, as many as fill b_buf at this K
+    size_t col_blocks;   // nc-wide column blocks of each C_b
+    size_t group_blocks; // GEMM_MC row blocks per task
+    size_t row_groups;   // row groups of each C_b
+    uint8_t *scratch;    // see gemm_job_t
+    const pool_t *pool;
+} gemm_batched_job_t;
+
+// One task of gemm_batched: columns [jc, jc + nc) x one group of GEMM_MC row blocks of one C_b.
+// Each K block of B is packed once and serves every row block of the group.
+static void gemm_batched_task(void *arg, size_t task)
+{
+    const gemm_batched_job_t *job = (const gemm_batched_job_t *)arg;
+    const kernels_t *kern = job->kern;
+    const size_t MR = kern->gemm_mr;
+    const size_t per_batch = job->row_groups * job->col_blocks;
+    const size_t b = task / per_batch;
+    const size_t i0 = (task % per_batch) / job->col_blocks * job->group_blocks * GEMM_MC;
+    const size_t i1 = m_min(i0 + job->group_blocks * GEMM_MC, job->M);
+    const size_t jc = (task % per_batch) % job->col_blocks * job->nc;
+    const size_t nc = m_min(job->nc, job->N - jc);
+    const gemm_operand_t A = job->A, B = job->B;
+    const float *a_b = A.data + b * A.stride, *b_b = B.data + b * B.stride;
+    float *C = job->C + b * job->stride_c + jc;
+    const size_t ldc = job->ldc;
+
+    // packed blocks of both operands, in this thread's slice like gemm_task's a_buf
+    float *a_buf = (float *)gemm_thread_scratch(job->scratch, job->pool);
+    float *b_buf = a_buf + GEMM_MC * GEMM_KC;
+    _Alignas(64) float tile[GEMM_MR_MAX * GEMM_NR];
+
+    for (size_t pc = 0; pc < job->K; pc += GEMM_KC)
+    {
+        const size_t kc = m_min(GEMM_KC, job->K - pc);
+        const bool accumulate = pc > 0;
+        if (B.trans)
+            gemm_pack_b(b_buf, b_b + jc * B.ld + pc, kc, nc, B.ld, true);
+        else
+            gemm_pack_b(b_buf, b_b + pc * B.ld + jc, kc, nc, B.ld, false);
+
+        for (size_t ic = i0; ic < i1; ic += GEMM_MC)
+        {
+            const size_t mc = m_min(GEMM_MC, i1 - ic);
+            if (A.trans)
+                gemm_pack_a_trans(a_buf, a_b + pc * A.ld + ic, A.ld, mc, kc, MR);
+            else
+                gemm_pack_a(a_buf, a_b + ic * A.ld + pc, A.ld, mc, kc, MR);
+
+            for (size_t jr = 0; jr < nc; jr += GEMM_NR)
+            {
+                const float *bp = b_buf + jr / GEMM_NR * kc * GEMM_NR;
+                const size_t nr = m_min(GEMM_NR, nc - jr);
+                for (size_t ir = 0; ir < mc; ir += MR)
+                {
+                    const size_t mr = m_min(MR, mc - ir);
+                    const float *a = a_buf + ir * kc;
+                    float *c = C + (ic + ir) * ldc + jr;
+                    if (mr == MR && nr == GEMM_NR)
+                    {
+                        kern->gemm_ukernel(kc, a, bp, c, ldc, accumulate);
+                        continue;
+                    }
+                    // edge tile, as in gemm_task
+                    if (accumulate)
+                        for (size_t i = 0; i < mr; ++i)
+                            memcpy(tile + i * GEMM_NR, c + i * ldc, nr * sizeof(float));
+                    kern->gemm_ukernel(kc, a, bp, tile, GEMM_NR, accumulate);
+                    for (size_t i = 0; i < mr; ++i)
+                        memcpy(c + i * ldc, tile + i * GEMM_NR, nr * sizeof(float));
+                }
+            }
+        }
+    }
+}
+
+void gemm_batched(size_t batch, size_t M, size_t N, size_t K,
+                  gemm_operand_t A, gemm_operand_t B,
+                  float *C, size_t ldc, size_t stride_c,
+                  void *scratch, pool_t *pool)
+{
+    if (K == 0)
+    {
+        for (size_t b = 0; b < batch; ++b)
+            for (size_t i = 0; i < M; ++i)
+                memset(C + b * stride_c + i * ldc, 0, N * sizeof(float));
+        return;
+    }
+    if (batch == 0 || M == 0 || N == 0)
+        return;
+    // A short K (a head dimension) leaves room for more columns per packed B block.
+    const size_t nc = GEMM_KC * GEMM_NC / m_min(K, GEMM_KC) / GEMM_NR * GEMM_NR;
+    const size_t col_blocks = (N + nc - 1) / nc, row_blocks = (M + GEMM_MC - 1) / GEMM_MC;
+    // Rows are only split as far as needed to give every thread a few tasks, since each
+    // row group packs its own copy of B.
+    const size_t threads = pool_size(pool);
+    size_t row_groups = (4 * threads + batch * col_blocks - 1) / (batch * col_blocks);
+    row_groups = m_min(row_groups, row_blocks);
+    const size_t group_blocks = (row_blocks + row_groups - 1) / row_groups;
+    gemm_batched_job_t job = {
+        .kern = kernels_get(),
+        .M = M, .N = N, .K = K,
+        .A = A, .B = B,
+        .C = C, .ldc = ldc, .stride_c = stride_c,
+        .nc = nc,
+        .col_blocks = col_blocks,
+        .group_blocks = group_blocks,
+        .row_groups = (row_blocks + group_blocks - 1) / group_blocks,
+        .scratch = (uint8_t *)scratch,
+        .pool = pool,
+    };
+    pool_run(pool, batch * job.row_groups * col_blocks, gemm_batched_task, &job);
+}
+
+static void gemm_run(gemm_job_t *job, const gemm_epilogue_t *epi, pool_t *pool)
+{
+    const size_t M = job->M, N = job->N, K = job->K;
+    if (K == 0)
+    {
+        for (size_t i = 0; i < M; ++i)
+            memset(job->C + i * job->ldc, 0, N * sizeof(float));
+        if (epi)
+            gemm_epilogue_tile(job->kern, epi, job->C, job->ldc, 0, 0, M, N);
+        return;
+    }
+
+    job->epi = epi;
+    job->panels = (N + GEMM_NR - 1) / GEMM_NR;
+    const gemm_tiling_t tiling = gemm_get_tiling();
+    job->mc = job->B_i8 ? GEMM_MC : tiling.mc;
+    job->kc = tiling.kc;
+
+    // Split N as well as M so that a single row block still feeds every thread;
+    // a few tasks per thread keeps the dynamic scheduling balanced.
+    const size_t row_blocks = (M + job->mc - 1) / job->mc;
+    const size_t threads = pool_size(pool);
+    size_t n_chunks = threads > 1 ? (4 * threads + row_blocks - 1) / row_blocks : 1;
+    n_chunks = m_min(n_chunks, job->panels);
+    job->chunk_panels = (job->panels + n_chunks - 1) / n_chunks;
+    job->n_chunks = (job->panels + job->chunk_panels - 1) / job->chunk_panels;
+
+    pool_run(pool, row_blocks * job->n_chunks,
+             job->B_i8 ? gemm_i8_task : job->skinny ? gemm_skinny_task : gemm_task, job);
+}
+
+void gemm_packed(size_t M, size_t N, size_t K,
+                 const float *A, size_t lda,
+                 const float *B_packed,
+                 float *C, size_t ldc,
+                 const gemm_epilogue_t *epi,
+                 void *scratch,
+                 pool_t *pool)
+{
+    gemm_job_t job = {
+        .kern = kernels_get(),
+        .M = M, .N = N, .K = K,
+        .A = A, .lda = lda,
+        .B_packed = B_packed,
+        .C = C, .ldc = ldc,
+        .scratch = (uint8_t *)scratch,
+        .pool = pool,
+    };
+    gemm_run(&job, epi, pool);
+}
+
+void gemm_packed_f16(size_t M, size_t N, size_t K,
+                     const float *A, size_t lda,
+                     const uint16_t *B_packed,
+                     float *C, size_t ldc,
+                     const gemm_epilogue_t *epi,
+                     void *scratch,
+                     pool_t *pool)
+{
+    gemm_job_t job = {
+        .kern = kernels_get(),
+        .M = M, .N = N, .K = K,
+        .A = A, .lda = lda,
+        .B_f16 = B_packed,
+        .C = C, .ldc = ldc,
+        .scratch = (uint8_t *)scratch,
+        .pool = pool,
+    };
+    gemm_run(&job, epi, pool);
+}
+
+void gemm_skinny(size_t M, size_t N, size_t K,
+                 const float *A, size_t lda,
+                 const float *B_packed,
+                 float *C, size_t ldc,
+                 const gemm_epilogue_t *epi,
+                 pool_t *pool)
+{
+    assert(M <= GEMM_SKINNY_MAX);
+    gemm_job_t job = {
+        .kern = kernels_get(),
+        .M = M, .N = N, .K = K,
+        .A = A, .lda = lda,
+        .B_packed = B_packed,
+        .skinny = true,
+        .C = C, .ldc = ldc,
+    };
+    gemm_run(&job, epi, pool);
+}
+
+void gemm_skinny_f16(size_t M, size_t N, size_t K,
+                     const float *A, size_t lda,
+                     const uint16_t *B_packed,
+                     float *C, size_t ldc,
+                     const gemm_epilogue_t *epi,
+                     pool_t *pool)
+{
+    assert(M <= GEMM_SKINNY_MAX);
+    gemm_job_t job = {
+        .kern = kernels_get(),
+        .M = M, .N = N, .K = K,
+        .A = A, .lda = lda,
+        .B_f16 = B_packed,
+        .skinny = true,
+        .C = C, .ldc = ldc,
+    };
+    gemm_run(&job, epi, pool);
+}
+
+void gemm_packed_i8(size_t M, size_t N, size_t K,
+                    const float *A, size_t lda,
+                    const int8_t *B_packed, const float *b_scale, const int32_t *b_sum,
+                    float *C, size_t ldc,
+                    const gemm_epilogue_t *epi,
+                    void *scratch,
+                    pool_t *pool)
+{
+    assert(K <= GEMM_I8_KMAX);
+    gemm_job_t job = {
+        .kern = kernels_get(),
+        .M = M, .N = N, .K = K,
+        .A = A, .lda = lda,
+        .B_i8 = B_packed, .b_scale = b_scale, .b_sum = b_sum,
+        .C = C, .ldc = ldc,
+        .scratch = (uint8_t *)scratch,
+        .pool = pool,
+    };
+    gemm_run(&job, epi, pool);
+}
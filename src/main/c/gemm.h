@@ -0,0 +1,188 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "pool.h"
+
+/// Packed-panel SGEMM.
+///
+/// B is stored as column panels of GEMM_NR floats (see tensor_packed_t): panel p holds
+/// columns [p * GEMM_NR, (p + 1) * GEMM_NR) as a row-major [K, GEMM_NR] block.
+/// A is packed on the fly into GEMM_MC x GEMM_KC blocks of MR-row micro-panels and
+/// every MR x GEMM_NR tile of C is computed by the register-blocked microkernel of the
+/// kernel table picked at runtime (see kernels.h), so MR depends on the CPU.
+
+#define GEMM_NR 16
+#define GEMM_MR_MAX 16
+#define GEMM_MC 96
+#define GEMM_KC 256
+
+/// Runtime blocking of gemm_packed and gemm_packed_f16: A is packed in blocks of mc rows
+/// by kc columns, GEMM_MC x GEMM_KC by default. The best pair depends on the L1/L2 sizes,
+/// so the autotuner (autotune.h) picks it per CPU model. The packed B layout does not
+/// depend on it, so it may change between calls.
+
+#define GEMM_MC_MAX 192
+#define GEMM_KC_MAX 384
+
+typedef struct gemm_tiling_t
+{
+    size_t mc; // rows of a packed A block, <= GEMM_MC_MAX; best a multiple of every MR (12)
+    size_t kc; // K block, <= GEMM_KC_MAX
+} gemm_tiling_t;
+
+/// @brief Use `t` for every later gemm_packed / gemm_packed_f16 call
+/// @return false (and nothing changes) when a field is 0 or above its maximum
+bool gemm_set_tiling(gemm_tiling_t t);
+
+/// @brief The blocking currently in use
+gemm_tiling_t gemm_get_tiling(void);
+
+/// @brief Number of floats needed to pack B[K, N]
+size_t gemm_packed_b_size(size_t K, size_t N);
+
+/// @brief Pack B[K, N] (row stride ldb) into column panels, zero-filling the tail panel.
+/// With trans, the source is B^T[N, K] (row stride ldb), i.e. a PyTorch linear weight.
+void gemm_pack_b(float *dst, const float *src, size_t K, size_t N, size_t ldb, bool trans);
+
+/// @brief gemm_pack_b for IEEE half (FP16) weights: the same panel layout at 2 bytes per
+/// element, so each k row of a panel is 32 bytes. `dst` must be 32-byte aligned.
+void gemm_pack_b_f16(uint16_t *dst, const uint16_t *src, size_t K, size_t N, size_t ldb, bool trans);
+
+/// Packing buffers: gemm_packed, gemm_packed_f16, gemm_packed_i8 and gemm_batched pack
+/// their blocks into `scratch`, one gemm_scratch_size(1) slice per thread of `pool` (see
+/// pool_thread_index), so nothing stays allocated between calls. It is owned by the call:
+/// gemm_scratch_size(pool_size(pool)) bytes, 64-byte aligned, not used by another call at
+/// the same time. The skinny GEMM packs nothing.
+
+/// @brief Bytes of `scratch` a GEMM call needs on `n_threads` threads
+size_t gemm_scratch_size(size_t n_threads);
+
+/// @brief Activation of a gemm_epilogue_t
+typedef enum gemm_act_t
+{
+    GEMM_ACT_NONE,
+    GEMM_ACT_GELU,     // tanh approximation
+    GEMM_ACT_GELU_ERF, // exact erf form
+} gemm_act_t;
+
+/// @brief Elementwise work applied to each tile of C right after its last K block,
+/// while the tile is still hot: C = act(A x B + bias) + residual
+typedef struct gemm_epilogue_t
+{
+    const float *bias;     // [N], NULL = none
+    gemm_act_t act;        // applied after the bias
+    const float *residual; // [M, N] with row stride ld_residual, added last; must not alias C. NULL = none
+    size_t ld_residual;
+} gemm_epilogue_t;
+
+/// @brief C[M, N] = A[M, K] x B[K, N], B packed by gemm_pack_b, then `epi` (NULL = none).
+/// Row blocks and column panel ranges of C are split across `pool` (NULL = single-threaded).
+void gemm_packed(size_t M, size_t N, size_t K,
+                 const float *A, size_t lda,
+                 const float *B_packed,
+                 float *C, size_t ldc,
+                 const gemm_epilogue_t *epi,
+                 void *scratch,
+                 pool_t *pool);
+
+/// @brief gemm_packed with B packed by gemm_pack_b_f16.
+/// The microkernel widens each B row to FP32 as it loads it, so accumulation stays FP32
+/// and only the weight traffic is halved.
+void gemm_packed_f16(size_t M, size_t N, size_t K,
+                     const float *A, size_t lda,
+                     const uint16_t *B_packed,
+                     float *C, size_t ldc,
+                     const gemm_epilogue_t *epi,
+                     void *scratch,
+                     pool_t *pool);
+
+/// Strided batched GEMM on views.
+///
+/// For every b < batch: C_b[M, N] = op(A_b)[M, K] x op(B_b)[K, N], where X_b starts at
+/// X + b * stride_x and op(X) = X^T with trans_x. An operand is row-major with row stride
+/// ld (its rows are rows of X_b, or rows of X_b^T with trans), so head slices of a packed
+/// [S, 3 * HIDDEN] activation, K^T and shared (stride 0) operands need no copies. C rows
+/// have unit column stride and are overwritten.
+///
+/// Both operands are packed per task, into GEMM_KC x GEMM_NC blocks of B (more columns
+/// when K is shorter) and GEMM_MC x GEMM_KC blocks of A, then run on the same microkernels
+/// as gemm_packed. Tasks are (batch entry, one B block of columns, a group of GEMM_MC row
+/// blocks that share it) and are split across `pool`.
+
+#define GEMM_NC 128
+
+/// @brief One operand of gemm_batched
+typedef struct gemm_operand_t
+{
+    const float *data;
+    size_t ld;     // row stride of the stored matrix
+    size_t stride; // batch stride, 0 = the same matrix for every batch entry
+    bool trans;    // stored as the transpose of the operand
+} gemm_operand_t;
+
+/// @brief C_b = op(A_b) x op(B_b) for b < batch, see above; C_b = C + b * stride_c
+void gemm_batched(size_t batch, size_t M, size_t N, size_t K,
+                  gemm_operand_t A, gemm_operand_t B,
+                  float *C, size_t ldc, size_t stride_c,
+                  void *scratch, pool_t *pool);
+
+/// Skinny GEMM, for the few-row products of short queries.
+///
+/// With M <= GEMM_SKINNY_MAX rows, packing A and padding it to whole MR-row tiles costs more
+/// than the product itself. These variants read A in place, keep all M rows of accumulators
+/// in registers and stream each packed panel of B once over all of K; column panels are
+/// split across `pool`. B and `epi` are as for gemm_packed / gemm_packed_f16.
+
+#define GEMM_SKINNY_MAX 16
+
+/// @brief gemm_packed for M <= GEMM_SKINNY_MAX
+void gemm_skinny(size_t M, size_t N, size_t K,
+                 const float *A, size_t lda,
+                 const float *B_packed,
+                 float *C, size_t ldc,
+                 const gemm_epilogue_t *epi,
+                 pool_t *pool);
+
+/// @brief gemm_packed_f16 for M <= GEMM_SKINNY_MAX
+void gemm_skinny_f16(size_t M, size_t N, size_t K,
+                     const float *A, size_t lda,
+                     const uint16_t *B_packed,
+                     float *C, size_t ldc,
+                     const gemm_epilogue_t *epi,
+                     pool_t *pool);
+
+/// INT8 dynamically quantized GEMM.
+///
+/// B is quantized once to int8 with one scale per column (output channel); A is quantized
+/// per row on the fly, inside each task. Products are summed exactly in int32 by the
+/// kernel table's int8 microkernel over all of K (no K blocking: an int8 panel of
+/// GEMM_I8_KMAX rows is 32 KB), then scaled back to float before the epilogue:
+/// C = act(scale_a[i] * scale_b[j] * (qA x qB)[i, j] + bias) + residual.
+///
+/// Packed B: panels of GEMM_NR columns as in gemm_pack_b, but k grouped by 4: for each
+/// k / 4, GEMM_NR groups of 4 bytes (4 consecutive k of one column). K is zero-padded to a
+/// multiple of 4.
+
+/// @brief Largest K the int8 GEMM supports (size of the per-thread quantized A block)
+#define GEMM_I8_KMAX 2048
+
+/// @brief Number of bytes needed for int8 B[K, N]
+size_t gemm_packed_b_i8_size(size_t K, size_t N);
+
+/// @brief Quantize a linear weight W[N, K] (PyTorch layout, row stride ldw) as B = W^T.
+/// Each column of B gets scale = max|W[n, :]| / 127 and q = round(W / scale).
+/// @param dst gemm_packed_b_i8_size(K, N) bytes, 64-byte aligned
+/// @param scale [N] dequantization scales
+/// @param sum [ceil(N / GEMM_NR) * GEMM_NR] column sums of the quantized values, 64-byte aligned
+void gemm_quantize_b(int8_t *dst, float *scale, int32_t *sum, const float *w, size_t K, size_t N, size_t ldw);
+
+/// @brief C[M, N] = A[M, K] x B[K, N] with B from gemm_quantize_b and A quantized per row,
+/// then `epi` (NULL = none). K <= GEMM_I8_KMAX.
+void gemm_packed_i8(size_t M, size_t N, size_t K,
+                    const float *A, size_t lda,
+                    const int8_t *B_packed, const float *b_scale, const int32_t *b_sum,
+                    float *C, size_t ldc,
+                    const gemm_epilogue_t *epi,
+                    void *scratch,
+                    pool_t *pool);
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 199309L
+#include "gemm.h"
+#include "kernels.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The scalar tiled loop tensor_matmul used before the packed GEMM, kept as the baseline.
+static void matmul_reference(size_t M, size_t N, size_t K, const float *a, const float *b, float *c)
+{
+    const size_t BM = 128, BN = 128, BK = 64;
+    memset(c, 0, M * N * sizeof(float));
+    for (size_t i0 = 0; i0 < M; i0 += BM)
+        for (size_t j0 = 0; j0 < N; j0 += BN)
+        {
+            const size_t imax = (i0 + BM < M) ? (i0 + BM) : M;
+            const size_t jmax = (j0 + BN < N) ? (j0 + BN) : N;
+            for (size_t k0 = 0; k0 < K; k0 += BK)
+            {
+                const size_t kmax = (k0 + BK < K) ? (k0 + BK) : K;
+                for (size_t i = i0; i < imax; ++i)
+                {
+                    float *c_row = c + i * N;
+                    for (size_t k = k0; k < kmax; ++k)
+                    {
+                        const float aik = a[i * K + k];
+                        const float *b_row = b + k * N;
+                        for (size_t j = j0; j < jmax; ++j)
+                            c_row[j] += aik * b_row[j];
+                    }
+                }
+            }
+        }
+}
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void fill_random(float *x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        x[i] = (float)rand() / (float)RAND_MAX - 0.5f;
+}
+
+// random halves in about (-0.5, 0.5), so the FP16 and FP32 runs multiply the same values
+static void fill_random_f16(uint16_t *x, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        x[i] = (uint16_t)((rand() & 0x8000) | (0x2000 + rand() % 0x1800));
+}
+
+static void bench_shape(size_t M, size_t N, size_t K, pool_t *pool)
+{
+    float *a = malloc(M * K * sizeof(float));
+    float *b = malloc(K * N * sizeof(float));
+    uint16_t *b16 = malloc(K * N * sizeof(uint16_t));
+    float *c_ref = malloc(M * N * sizeof(float));
+    float *c = malloc(M * N * sizeof(float));
+    float *b_packed = aligned_alloc(64, gemm_packed_b_size(K, N) * sizeof(float));
+    uint16_t *b_packed16 = aligned_alloc(64, gemm_packed_b_size(K, N) * sizeof(float));
+    void *scratch = aligned_alloc(64, gemm_scratch_size(pool_size(pool)));
+    assert(a && b && b16 && c_ref && c && b_packed && b_packed16 && scratch);
+    fill_random(a, M * K);
+    fill_random_f16(b16, K * N);
+    kernels_get()->widen_f16(b, b16, K * N);
+    gemm_pack_b(b_packed, b, K, N, N, false);
+    gemm_pack_b_f16(b_packed16, b16, K, N, N, false);
+
+    const double flops = 2.0 * (double)M * (double)N * (double)K;
+    const int iters = (int)(2e9 / flops) + 1;
+
+    double t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        matmul_reference(M, N, K, a, b, c_ref);
+    const double t_ref = (now_s() - t0) / iters;
+
+    t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_packed(M, N, K, a, K, b_packed, c, N, NULL, scratch, NULL);
+    const double t_gemm = (now_s() - t0) / iters;
+
+    t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_packed(M, N, K, a, K, b_packed, c, N, NULL, scratch, pool);
+    const double t_pool = (now_s() - t0) / iters;
+
+    float max_err = 0.0f;
+    for (size_t i = 0; i < M * N; i++)
+        max_err = fmaxf(max_err, fabsf(c[i] - c_ref[i]));
+    assert(max_err < 1e-3f);
+
+    t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_packed_f16(M, N, K, a, K, b_packed16, c, N, NULL, scratch, NULL);
+    const double t_f16 = (now_s() - t0) / iters;
+    for (size_t i = 0; i < M * N; i++)
+        max_err = fmaxf(max_err, fabsf(c[i] - c_ref[i]));
+    assert(max_err < 1e-3f);
+
+    // int8: B quantized per column (from B^T, the linear weight layout), A per row on every call
+    const size_t panels = (N + GEMM_NR - 1) / GEMM_NR;
+    float *bt = malloc(K * N * sizeof(float));
+    int8_t *b_i8 = aligned_alloc(64, gemm_packed_b_i8_size(K, N));
+    float *b_scale = malloc(N * sizeof(float));
+    int32_t *b_sum = aligned_alloc(64, panels * GEMM_NR * sizeof(int32_t));
+    assert(bt && b_i8 && b_scale && b_sum);
+    for (size_t k = 0; k < K; k++)
+        for (size_t j = 0; j < N; j++)
+            bt[j * K + k] = b[k * N + j];
+    gemm_quantize_b(b_i8, b_scale, b_sum, bt, K, N, K);
+    t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_packed_i8(M, N, K, a, K, b_i8, b_scale, b_sum, c, N, NULL, scratch, NULL);
+    const double t_i8 = (now_s() - t0) / iters;
+    // quantization error, relative to the largest output
+    float i8_err = 0.0f, c_max = 0.0f;
+    for (size_t i = 0; i < M * N; i++)
+    {
+        i8_err = fmaxf(i8_err, fabsf(c[i] - c_ref[i]));
+        c_max = fmaxf(c_max, fabsf(c_ref[i]));
+    }
+    assert(i8_err <= 0.05f * c_max);
+
+    printf("M=%4zu N=%5zu K=%5zu | reference %7.2f GFLOP/s | packed %7.2f GFLOP/s | x%5.2f | fp16 B %7.2f | int8 %7.2f GOP/s (err %.1e) | %zu threads %7.2f GFLOP/s | max err %.2e\n",
+           M, N, K, flops / t_ref * 1e-9, flops / t_gemm * 1e-9, t_ref / t_gemm, flops / t_f16 * 1e-9,
+           flops / t_i8 * 1e-9, i8_err / c_max, pool_size(pool), flops / t_pool * 1e-9, max_err);
+
+    free(bt);
+    free(b_i8);
+    free(b_scale);
+    free(b_sum);
+
+    free(a);
+    free(b);
+    free(b16);
+    free(b_packed16);
+    free(c_ref);
+    free(c);
+    free(b_packed);
+    free(scratch);
+}
+
+// Short queries: the blocked GEMM against the skinny one, per call latency
+static void bench_skinny(size_t M, size_t N, size_t K, pool_t *pool)
+{
+    float *a = malloc(M * K * sizeof(float));
+    float *b = malloc(K * N * sizeof(float));
+    float *c_ref = malloc(M * N * sizeof(float));
+    float *c = malloc(M * N * sizeof(float));
+    float *b_packed = aligned_alloc(64, gemm_packed_b_size(K, N) * sizeof(float));
+    void *scratch = aligned_alloc(64, gemm_scratch_size(1));
+    assert(a && b && c_ref && c && b_packed && scratch);
+    fill_random(a, M * K);
+    fill_random(b, K * N);
+    gemm_pack_b(b_packed, b, K, N, N, false);
+    const double flops = 2.0 * (double)M * (double)N * (double)K;
+    const int iters = (int)(2e8 / flops) + 1;
+
+    double t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_packed(M, N, K, a, K, b_packed, c_ref, N, NULL, scratch, NULL);
+    const double t_gemm = (now_s() - t0) / iters;
+
+    t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_skinny(M, N, K, a, K, b_packed, c, N, NULL, NULL);
+    const double t_skinny = (now_s() - t0) / iters;
+
+    t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_skinny(M, N, K, a, K, b_packed, c, N, NULL, pool);
+    const double t_pool = (now_s() - t0) / iters;
+
+    float max_err = 0.0f;
+    for (size_t i = 0; i < M * N; i++)
+        max_err = fmaxf(max_err, fabsf(c[i] - c_ref[i]));
+    assert(max_err < 1e-3f);
+
+    printf("M=%4zu N=%5zu K=%5zu | packed %7.2f us | skinny %7.2f us | x%5.2f | %zu threads %7.2f us\n",
+           M, N, K, t_gemm * 1e6, t_skinny * 1e6, t_gemm / t_skinny, pool_size(pool), t_pool * 1e6);
+
+    free(a);
+    free(b);
+    free(c_ref);
+    free(c);
+    free(b_packed);
+    free(scratch);
+}
+
+// Attention scores straight on head slices of a packed QKV buffer, scores_h = Q_h K_h^T,
+// against copying each head into contiguous Q_h and K_h^T first (what tensor_bmm did)
+static void bench_batched(size_t S, size_t heads, size_t d, pool_t *pool)
+{
+    const size_t H = heads * d, ld_qkv = 3 * H;
+    float *qkv = malloc(S * ld_qkv * sizeof(float));
+    float *scores = malloc(heads * S * S * sizeof(float));
+    float *ref = malloc(heads * S * S * sizeof(float));
+    float *qh = malloc(S * d * sizeof(float));
+    float *kt = malloc(d * S * sizeof(float));
+    float *kt_packed = aligned_alloc(64, gemm_packed_b_size(d, S) * sizeof(float));
+    void *scratch = aligned_alloc(64, gemm_scratch_size(pool_size(pool)));
+    assert(qkv && scores && ref && qh && kt && kt_packed && scratch);
+    fill_random(qkv, S * ld_qkv);
+    const gemm_operand_t q = {.data = qkv, .ld = ld_qkv, .stride = d};
+    const gemm_operand_t k = {.data = qkv + H, .ld = ld_qkv, .stride = d, .trans = true};
+    const double flops = 2.0 * (double)heads * (double)S * (double)S * (double)d;
+    const int iters = (int)(1e9 / flops) + 1;
+
+    double t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        gemm_batched(heads, S, S, d, q, k, scores, S, S * S, scratch, pool);
+    const double t_batched = (now_s() - t0) / iters;
+
+    t0 = now_s();
+    for (int it = 0; it < iters; it++)
+        for (size_t h = 0; h < heads; h++)
+        {
+            for (size_t i = 0; i < S; i++)
+                memcpy(qh + i * d, qkv + i * ld_qkv + h * d, d * sizeof(float));
+            for (size_t i = 0; i < S; i++)
+                for (size_t c = 0; c < d; c++)
+                    kt[c * S + i] = qkv[i * ld_qkv + H + h * d + c];
+            gemm_pack_b(kt_packed, kt, d, S, S, false);
+            gemm_packed(S, S, d, qh, d, kt_packed, ref + h * S * S, S, NULL, scratch, pool);
+        }
+    const double t_copies = (now_s() - t0) / iters;
+
+    float max_err = 0.0f;
+    for (size_t i = 0; i < heads * S * S; i++)
+        max_err = fmaxf(max_err, fabsf(scores[i] - ref[i]));
+    assert(max_err < 1e-4f);
+
+    printf("S=%4zu heads=%3zu d=%4zu | Q K^T batched on views %7.2f GFLOP/s | per-head copies %7.2f GFLOP/s | max err %.2e\n",
+           S, heads, d, flops / t_batched * 1e-9, flops / t_copies * 1e-9, max_err);
+
+    free(qkv);
+    free(scores);
+    free(ref);
+    free(qh);
+    free(kt);
+    free(kt_packed);
+    free(scratch);
+}
+
+int main(void)
+{
+    const kernels_t *kern = kernels_init();
+    printf("kernels: %s, gemm tile %zux%d\n", kern->name, kern->gemm_mr, GEMM_NR);
+    pool_t *pool = pool_create(0);
+    // MiniLM-L6 linear layers at 128 tokens, attention products, then odd shapes for the edge paths
+    bench_shape(128, 384, 384, pool);
+    bench_shape(128, 1536, 384, pool);
+    bench_shape(128, 384, 1536, pool);
+    bench_shape(128, 128, 32, pool);
+    bench_shape(128, 32, 128, pool);
+    bench_shape(16, 384, 384, pool);
+    bench_shape(37, 383, 301, pool);
+    bench_shape(512, 512, 512, pool);
+    bench_batched(128, 12, 32, pool);
+    bench_batched(512, 12, 32, pool);
+    // single short queries through the same layers
+    for (size_t m = 3; m <= GEMM_SKINNY_MAX; m += 6)
+    {
+        bench_skinny(m, 384, 384, pool);
+        bench_skinny(m, 1536, 384, pool);
+        bench_skinny(m, 384, 1536, pool);
+    }
+    pool_destroy(pool);
+    return 0;
+}
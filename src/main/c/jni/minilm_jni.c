@@ -1,14 +1,23 @@
 #include <jni.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include "minilm.h"
 #include "tensor.h"
 
 // JNI function: Create a MiniLM session
+// nThreads: threads per embed call (0 = all CPUs, 1 = single-threaded)
 // Returns: jlong session handle (pointer to minilm_t)
 JNIEXPORT jlong JNICALL
-Java_io_vacco_minilm_MiniLM_nCreate(JNIEnv *env, jclass clazz, jstring tbfPath, jstring vocabPath)
+Java_io_vacco_minilm_MiniLM_nCreate(JNIEnv *env, jclass clazz, jstring tbfPath, jstring vocabPath, jint nThreads)
 {
+    if (nThreads < 0)
+    {
+        (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/IllegalArgumentException"),
+                         "Thread count cannot be negative");
+        return 0;
+    }
+
     // Convert Java strings to C strings
     const char *tbf_path = (*env)->GetStringUTFChars(env, tbfPath, NULL);
     if (tbf_path == NULL)
@@ -35,7 +44,8 @@ Java_io_vacco_minilm_MiniLM_nCreate(JNIEnv *env, jclass clazz, jstring tbfPath,
     }
 
     // Initialize the session
-    int result = minilm_create(m, tbf_path, vocab_path);
+    minilm_options_t opts = {.n_threads = (uint32_t)nThreads};
+    int result = minilm_create_with_options(m, tbf_path, vocab_path, opts);
 
     // Release Java string references
     (*env)->ReleaseStringUTFChars(env, tbfPath, tbf_path);
@@ -117,6 +127,87 @@ Java_io_vacco_minilm_MiniLM_nEmbed(JNIEnv *env, jclass clazz, jlong sessionHandl
     return result;
 }
 
+// JNI function: Embed several texts, batched by token count (see minilm_embed_bulk)
+// tokenBudget: max tokens per encoder batch, 0 = library default
+// Returns: jfloatArray of texts.length * 384 floats, one embedding after the other
+JNIEXPORT jfloatArray JNICALL
+Java_io_vacco_minilm_MiniLM_nEmbedBatch(JNIEnv *env, jclass clazz, jlong sessionHandle, jobjectArray texts, jint tokenBudget)
+{
+    minilm_t *m = (minilm_t *)sessionHandle;
+    if (m == NULL)
+    {
+        (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/IllegalArgumentException"),
+                         "Invalid session handle");
+        return NULL;
+    }
+
+    jsize n = (*env)->GetArrayLength(env, texts);
+    if (n > INT32_MAX / MINILM_HIDDEN_SIZE)
+    {
+        // the result is one float array of n * 384 elements, indexed by jsize
+        (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/IllegalArgumentException"),
+                         "Too many texts for one batch");
+        return NULL;
+    }
+    jstring *strings = (jstring *)calloc(n, sizeof(jstring));
+    const char **text_strs = (const char **)calloc(n, sizeof(char *));
+    size_t *text_lens = (size_t *)calloc(n, sizeof(size_t));
+    float *out = (float *)malloc((size_t)n * MINILM_HIDDEN_SIZE * sizeof(float));
+    jfloatArray result = NULL;
+    jsize pinned = 0;
+    if (!strings || !text_strs || !text_lens || !out)
+    {
+        (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/OutOfMemoryError"),
+                         "Failed to allocate batch buffers");
+        goto cleanup;
+    }
+
+    // Pin every string for the duration of the batch
+    for (; pinned < n; pinned++)
+    {
+        strings[pinned] = (jstring)(*env)->GetObjectArrayElement(env, texts, pinned);
+        if (strings[pinned] == NULL)
+        {
+            (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/IllegalArgumentException"),
+                             "Text cannot be null");
+            goto cleanup;
+        }
+        text_strs[pinned] = (*env)->GetStringUTFChars(env, strings[pinned], NULL);
+        if (text_strs[pinned] == NULL)
+        {
+            goto cleanup; // Exception already thrown
+        }
+        text_lens[pinned] = strlen(text_strs[pinned]);
+    }
+
+    if (minilm_embed_bulk(m, text_strs, text_lens, n, tokenBudget > 0 ? (size_t)tokenBudget : 0, out) != T_OK)
+    {
+        (*env)->ThrowNew(env, (*env)->FindClass(env, "java/lang/RuntimeException"),
+                         "Failed to generate embeddings");
+        goto cleanup;
+    }
+
+    result = (*env)->NewFloatArray(env, n * MINILM_HIDDEN_SIZE);
+    if (result != NULL)
+    {
+        (*env)->SetFloatArrayRegion(env, result, 0, n * MINILM_HIDDEN_SIZE, out);
+    }
+
+cleanup:
+    for (jsize i = 0; i < n && strings && text_strs; i++)
+    {
+        if (text_strs[i] != NULL)
+            (*env)->ReleaseStringUTFChars(env, strings[i], text_strs[i]);
+        if (strings[i] != NULL)
+            (*env)->DeleteLocalRef(env, strings[i]);
+    }
+    free(strings);
+    free(text_strs);
+    free(text_lens);
+    free(out);
+    return result;
+}
+
 // JNI function: Destroy a MiniLM session
 JNIEXPORT void JNICALL
 Java_io_vacco_minilm_MiniLM_nDestroy(JNIEnv *env, jclass clazz, jlong sessionHandle)
@@ -0,0 +1,168 @@
+// kernels.c — runtime selection of the per-ISA kernel tables
+#include "kernels.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <cpuid.h>
+extern const kernels_t kernels_sse42, kernels_avx2, kernels_avx512, kernels_avx512vnni;
+#else
+extern const kernels_t kernels_generic;
+#endif
+
+typedef struct
+{
+    const kernels_t *table;
+    bool supported;
+} kernels_variant_t;
+
+// entries kernels_probe fills: sse42, avx2, avx512, avx512vnni on x86, generic elsewhere
+#define KERNELS_MAX_VARIANTS 4
+
+#ifdef KERNELS_X86
+static uint64_t xgetbv0(void)
+{
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Best first. A variant needs the instructions *and* the OS saving the wider registers.
+static size_t kernels_probe(kernels_variant_t *variants)
+{
+    unsigned int a, b, c, d;
+    bool avx2 = false, avx512 = false, avx512vnni = false;
+
+    if (__get_cpuid(1, &a, &b, &c, &d))
+    {
+        const bool osxsave = (c & bit_OSXSAVE) != 0;
+        const bool avx_fma_f16c = (c & bit_AVX) && (c & bit_FMA) && (c & bit_F16C);
+        const uint64_t xcr0 = osxsave ? xgetbv0() : 0;
+        const bool ymm_state = (xcr0 & 0x06) == 0x06; // XMM | YMM
+        const bool zmm_state = (xcr0 & 0xe6) == 0xe6; // XMM | YMM | opmask | ZMM_Hi256 | Hi16_ZMM
+
+        if (__get_cpuid_count(7, 0, &a, &b, &c, &d))
+        {
+            avx2 = avx_fma_f16c && ymm_state && (b & bit_AVX2);
+            avx512 = avx2 && zmm_state &&
+                     (b & bit_AVX512F) && (b & bit_AVX512BW) && (b & bit_AVX512DQ) && (b & bit_AVX512VL);
+            avx512vnni = avx512 && (c & bit_AVX512VNNI);
+        }
+    }
+
+    // avx512vnni is avx512 plus the int8 dot product (vpdpbusd) for the quantized GEMM
+    variants[0] = (kernels_variant_t){&kernels_avx512vnni, avx512vnni};
+    variants[1] = (kernels_variant_t){&kernels_avx512, avx512};
+    variants[2] = (kernels_variant_t){&kernels_avx2, avx2};
+    // The rest of the library is built for SSE4.2, so it is the floor rather than a choice.
+    variants[3] = (kernels_variant_t){&kernels_sse42, true};
+    return 4;
+}
+#else
+static size_t kernels_probe(kernels_variant_t *variants)
+{
+    variants[0] = (kernels_variant_t){&kernels_generic, true};
+    return 1;
+}
+#endif
+
+// switched at runtime by kernels_use, so readers load it atomically
+static _Atomic(const kernels_t *) active = NULL;
+static pthread_once_t active_once = PTHREAD_ONCE_INIT;
+static bool active_forced = false;
+
+static void kernels_select(void)
+{
+    kernels_variant_t variants[KERNELS_MAX_VARIANTS] = {0};
+    const size_t n = kernels_probe(variants);
+
+    const kernels_t *table = NULL;
+    const char *forced = getenv("MINILM_ISA");
+    if (forced && *forced)
+    {
+        size_t i = 0;
+        while (i < n && strcmp(variants[i].table->name, forced) != 0)
+            ++i;
+        if (i == n)
+            fprintf(stderr, "[minilm] MINILM_ISA=%s is not a kernel variant of this build, ignoring\n", forced);
+        else if (variants[i].supported)
+            table = variants[i].table;
+        else
+            fprintf(stderr, "[minilm] MINILM_ISA=%s not supported by this CPU, ignoring\n", forced);
+    }
+    active_forced = table != NULL;
+
+    for (size_t i = 0; !table && i < n; ++i)
+        if (variants[i].supported)
+            table = variants[i].table;
+    atomic_store_explicit(&active, table, memory_order_release);
+}
+
+const kernels_t *kernels_init(void)
+{
+    pthread_once(&active_once, kernels_select);
+    return atomic_load_explicit(&active, memory_order_acquire);
+}
+
+const kernels_t *kernels_get(void)
+{
+    // pthread_once is a single load once initialized, cheap enough for per-op lookups
+    return kernels_init();
+}
+
+bool kernels_use(const char *name)
+{
+    kernels_init();
+    if (active_forced)
+        return false;
+    kernels_variant_t variants[KERNELS_MAX_VARIANTS] = {0};
+    const size_t n = kernels_probe(variants);
+    for (size_t i = 0; i < n; ++i)
+        if (variants[i].supported && strcmp(variants[i].table->name, name) == 0)
+        {
+            atomic_store_explicit(&active, variants[i].table, memory_order_release);
+            return true;
+        }
+    return false;
+}
+
+void kernels_cpu_name(char *buf, size_t n)
+{
+    snprintf(buf, n, "%s", "unknown");
+#ifdef KERNELS_X86
+    unsigned int regs[12];
+    if (__get_cpuid(0x80000000, &regs[0], &regs[1], &regs[2], &regs[3]) && regs[0] >= 0x80000004)
+    {
+        for (unsigned int leaf = 0; leaf < 3; ++leaf)
+            __get_cpuid(0x80000002 + leaf, &regs[4 * leaf], &regs[4 * leaf + 1], &regs[4 * leaf + 2], &regs[4 * leaf + 3]);
+        char brand[sizeof(regs) + 1];
+        memcpy(brand, regs, sizeof(regs));
+        brand[sizeof(regs)] = '\0';
+        // the brand string is space-padded on some parts
+        const char *start = brand;
+        while (*start == ' ')
+            start++;
+        size_t len = strlen(start);
+        while (len && start[len - 1] == ' ')
+            len--;
+        if (len)
+            snprintf(buf, n, "%.*s", (int)len, start);
+    }
+#endif
+}
+
+size_t kernels_supported(const kernels_t **tables, size_t max)
+{
+    kernels_variant_t variants[KERNELS_MAX_VARIANTS] = {0};
+    const size_t n = kernels_probe(variants);
+    size_t count = 0;
+    for (size_t i = 0; i < n && count < max; ++i)
+        if (variants[i].supported)
+            tables[count++] = variants[i].table;
+    return count;
+}
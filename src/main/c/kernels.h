@@ -0,0 +1,82 @@
+#pragma once
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Hot kernels, compiled once per ISA level from kernels_isa.c.
+///
+/// The library itself is built for a portable baseline; kernels_init() checks cpuid
+/// once and every caller goes through the table it selects.
+typedef struct kernels_t
+{
+    const char *name;
+
+    /// @brief Rows of the GEMM microkernel tile (columns are always GEMM_NR)
+    size_t gemm_mr;
+    /// @brief c[MR, GEMM_NR] (+)= a[kc, MR] x b[kc, GEMM_NR], see gemm.h for the packed layouts
+    void (*gemm_ukernel)(size_t kc, const float *a, const float *b, float *c, size_t ldc, bool accumulate);
+    /// @brief gemm_ukernel on FP16 panels of b (gemm_pack_b_f16), widened to FP32 in registers
+    void (*gemm_ukernel_f16)(size_t kc, const float *a, const uint16_t *b, float *c, size_t ldc, bool accumulate);
+    /// @brief dst = (float)src for n IEEE half values, exact
+    void (*widen_f16)(float *dst, const uint16_t *src, size_t n);
+    /// @brief c[MR, GEMM_NR] = a[kq, MR, 4] x b[kq, GEMM_NR, 4] in int32, all of K at once
+    /// (K = 4 * kq), operands in [-127, 127] laid out by gemm_quantize_a/b; `b_sum` holds
+    /// the GEMM_NR column sums of b and `c` is a 64-byte aligned [MR, GEMM_NR] tile
+    void (*gemm_ukernel_i8)(size_t kq, const int8_t *a, const int8_t *b, const int32_t *b_sum, int32_t *c);
+    /// @brief c[m, GEMM_NR] = a[m, K] x b[K, GEMM_NR] for m <= GEMM_SKINNY_MAX, all of K at once:
+    /// `a` is read in place (row stride lda), b is one packed panel and is streamed once
+    void (*gemm_skinny_panel)(size_t m, size_t K, const float *a, size_t lda, const float *b, float *c, size_t ldc);
+    /// @brief gemm_skinny_panel on an FP16 panel of b (gemm_pack_b_f16)
+    void (*gemm_skinny_panel_f16)(size_t m, size_t K, const float *a, size_t lda, const uint16_t *b, float *c, size_t ldc);
+    /// @brief dst[j * ldd + i] = src[i * lds + j] for i < rows, j < cols: one cache tile of a
+    /// transpose, in 16x16 (AVX-512) or 8x8 register blocks
+    void (*transpose)(float *dst, size_t ldd, const float *src, size_t lds, size_t rows, size_t cols);
+
+    /// @brief out = (x - mean(x)) / sqrt(var(x) + eps) * gamma + beta over one row of n
+    void (*layer_norm_row)(float *out, const float *x, const float *gamma, const float *beta, size_t n, float eps);
+    /// @brief x = softmax(x) over one row of n, max-subtracted
+    void (*softmax_row)(float *x, size_t n);
+    /// @brief x = exp(x), <= 2 ULP; 0 below -87.3
+    void (*exp)(float *x, size_t n);
+    /// @brief x = tanh(x), <= 2 ULP
+    void (*tanh)(float *x, size_t n);
+    /// @brief x = erf(x), <= 3 ULP
+    void (*erf)(float *x, size_t n);
+    /// @brief x = gelu(x), tanh approximation
+    void (*gelu)(float *x, size_t n);
+    /// @brief x = gelu(x), exact form 0.5 * x * (1 + erf(x / sqrt(2)))
+    void (*gelu_erf)(float *x, size_t n);
+    /// @brief sum(a * b)
+    float (*dot)(const float *a, const float *b, size_t n);
+
+    /// @brief Fused attention for one head: o[n_q, d] = softmax(q k^T * scale, mask) v
+    /// q, k, v and o are head slices read in place: row i starts at ptr + i * ld.
+    /// Keys are visited in tiles with an online softmax, so no score matrix is stored.
+    /// `mask` is [n_kv] (0 = padding key) or NULL; d <= KERNELS_ATTN_MAX_D.
+    void (*attention)(const float *q, size_t ldq, size_t n_q,
+                      const float *k, const float *v, size_t ldkv, size_t n_kv,
+                      const float *mask, float scale, float *o, size_t ldo, size_t d);
+} kernels_t;
+
+/// Largest head size the fused attention kernel supports
+#define KERNELS_ATTN_MAX_D 128
+
+/// @brief Pick the best kernel table for this CPU. Thread-safe; only the first call probes.
+/// `MINILM_ISA=sse42|avx2|avx512|avx512vnni` (x86) or `generic` (other CPUs) forces a variant,
+/// if the CPU supports it; other values are reported on stderr and ignored.
+const kernels_t *kernels_init(void);
+
+/// @brief The table selected by kernels_init (which it calls if nobody has yet)
+const kernels_t *kernels_get(void);
+
+/// @brief Switch every later kernels_get to the variant `name` (see MINILM_ISA), e.g. from the
+/// autotuner. Jobs already running keep the table they started with.
+/// @return false if this CPU cannot run it, or if MINILM_ISA forces a variant
+bool kernels_use(const char *name);
+
+/// @brief CPU brand string (cpuid), "unknown" where there is none; keys per-CPU-model caches
+void kernels_cpu_name(char *buf, size_t n);
+
+/// @brief Every variant this CPU can run, best first; for tests and benchmarks
+/// @return number of tables written to `tables` (at most `max`)
+size_t kernels_supported(const kernels_t **tables, size_t max);
@@ -0,0 +1,1071 @@
+// kernels_isa.c — hot kernels, compiled once per ISA level
+//
+// The Makefile builds this file several times with different -m flags and
+// -DKERNELS_ISA=<name>; each build exports one `kernels_<name>` table and
+// everything else stays static, so the variants never clash at link time.
+#include "kernels.h"
+#include "gemm.h"
+#include "f16.h"
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#ifndef KERNELS_ISA
+#error "kernels_isa.c must be compiled with -DKERNELS_ISA=<name>"
+#endif
+
+#define m_cat_(a, b) a##b
+#define m_cat(a, b) m_cat_(a, b)
+#define m_str_(a) #a
+#define m_str(a) m_str_(a)
+
+// ---- GEMM microkernels ----
+// c[MR, GEMM_NR] (+)= a[kc, MR] x b[kc, GEMM_NR], a and b packed, b 64-byte aligned.
+// Each body is instantiated twice: for FP32 panels and for FP16 panels (gemm_pack_b_f16),
+// which differ only in how one GEMM_NR row of b is loaded; FP16 rows are widened in
+// registers, so the weights cross the memory bus at half the width.
+
+#if defined(__AVX512F__)
+
+#define GEMM_MR 12
+
+#define GEMM_LOAD_B_F32(b) _mm512_load_ps(b)
+#define GEMM_LOAD_B_F16(b) _mm512_cvtph_ps(_mm256_load_si256((const __m256i *)(b)))
+
+#define GEMM_UKERNEL(name, b_t, load_b)                                                          \
+    static void name(size_t kc, const float *__restrict a, const b_t *__restrict b,              \
+                     float *__restrict c, size_t ldc, bool accumulate)                           \
+    {                                                                                            \
+        __m512 c0 = _mm512_setzero_ps(), c1 = _mm512_setzero_ps(), c2 = _mm512_setzero_ps();    \
+        __m512 c3 = _mm512_setzero_ps(), c4 = _mm512_setzero_ps(), c5 = _mm512_setzero_ps();    \
+        __m512 c6 = _mm512_setzero_ps(), c7 = _mm512_setzero_ps(), c8 = _mm512_setzero_ps();    \
+        __m512 c9 = _mm512_setzero_ps(), c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();  \
+                                                                                                 \
+        for (size_t k = 0; k < kc; ++k)                                                          \
+        {                                                                                        \
+            const __m512 bv = load_b(b);                                                         \
+            c0 = _mm512_fmadd_ps(_mm512_set1_ps(a[0]), bv, c0);                                  \
+            c1 = _mm512_fmadd_ps(_mm512_set1_ps(a[1]), bv, c1);                                  \
+            c2 = _mm512_fmadd_ps(_mm512_set1_ps(a[2]), bv, c2);                                  \
+            c3 = _mm512_fmadd_ps(_mm512_set1_ps(a[3]), bv, c3);                                  \
+            c4 = _mm512_fmadd_ps(_mm512_set1_ps(a[4]), bv, c4);                                  \
+            c5 = _mm512_fmadd_ps(_mm512_set1_ps(a[5]), bv, c5);                                  \
+            c6 = _mm512_fmadd_ps(_mm512_set1_ps(a[6]), bv, c6);                                  \
+            c7 = _mm512_fmadd_ps(_mm512_set1_ps(a[7]), bv, c7);                                  \
+            c8 = _mm512_fmadd_ps(_mm512_set1_ps(a[8]), bv, c8);                                  \
+            c9 = _mm512_fmadd_ps(_mm512_set1_ps(a[9]), bv, c9);                                  \
+            c10 = _mm512_fmadd_ps(_mm512_set1_ps(a[10]), bv, c10);                               \
+            c11 = _mm512_fmadd_ps(_mm512_set1_ps(a[11]), bv, c11);                               \
+            a += GEMM_MR;                                                                        \
+            b += GEMM_NR;                                                                        \
+        }                                                                                        \
+                                                                                                 \
+        __m512 acc[GEMM_MR] = {c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11};                \
+        for (size_t i = 0; i < GEMM_MR; ++i)                                                     \
+        {                                                                                        \
+            float *c_row = c + i * ldc;                                                          \
+            if (accumulate)                                                                      \
+                acc[i] = _mm512_add_ps(acc[i], _mm512_loadu_ps(c_row));                          \
+            _mm512_storeu_ps(c_row, acc[i]);                                                     \
+        }                                                                                        \
+    }
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+#define GEMM_MR 6
+
+#define GEMM_LOAD_B_F32(b) _mm256_load_ps(b)
+#define GEMM_LOAD_B_F16(b) _mm256_cvtph_ps(_mm_load_si128((const __m128i *)(b)))
+
+#define GEMM_UKERNEL(name, b_t, load_b)                                                                          \
+    static void name(size_t kc, const float *__restrict a, const b_t *__restrict b,                              \
+                     float *__restrict c, size_t ldc, bool accumulate)                                           \
+    {                                                                                                            \
+        __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();                                            \
+        __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();                                            \
+        __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();                                            \
+        __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();                                            \
+        __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();                                            \
+        __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();                                            \
+                                                                                                                 \
+        for (size_t k = 0; k < kc; ++k)                                                                          \
+        {                                                                                                        \
+            const __m256 b0 = load_b(b);                                                                         \
+            const __m256 b1 = load_b(b + 8);                                                                     \
+            __m256 av;                                                                                           \
+            av = _mm256_broadcast_ss(a + 0);                                                                     \
+            c00 = _mm256_fmadd_ps(av, b0, c00);                                                                  \
+            c01 = _mm256_fmadd_ps(av, b1, c01);                                                                  \
+            av = _mm256_broadcast_ss(a + 1);                                                                     \
+            c10 = _mm256_fmadd_ps(av, b0, c10);                                                                  \
+            c11 = _mm256_fmadd_ps(av, b1, c11);                                                                  \
+            av = _mm256_broadcast_ss(a + 2);                                                                     \
+            c20 = _mm256_fmadd_ps(av, b0, c20);                                                                  \
+            c21 = _mm256_fmadd_ps(av, b1, c21);                                                                  \
+            av = _mm256_broadcast_ss(a + 3);                                                                     \
+            c30 = _mm256_fmadd_ps(av, b0, c30);                                                                  \
+            c31 = _mm256_fmadd_ps(av, b1, c31);                                                                  \
+            av = _mm256_broadcast_ss(a + 4);                                                                     \
+            c40 = _mm256_fmadd_ps(av, b0, c40);                                                                  \
+            c41 = _mm256_fmadd_ps(av, b1, c41);                                                                  \
+            av = _mm256_broadcast_ss(a + 5);                                                                     \
+            c50 = _mm256_fmadd_ps(av, b0, c50);                                                                  \
+            c51 = _mm256_fmadd_ps(av, b1, c51);                                                                  \
+            a += GEMM_MR;                                                                                        \
+            b += GEMM_NR;                                                                                        \
+        }                                                                                                        \
+                                                                                                                 \
+        __m256 acc[GEMM_MR][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};      \
+        for (size_t i = 0; i < GEMM_MR; ++i)                                                                     \
+        {                                                                                                        \
+            float *c_row = c + i * ldc;                                                                          \
+            if (accumulate)                                                                                      \
+            {                                                                                                    \
+                acc[i][0] = _mm256_add_ps(acc[i][0], _mm256_loadu_ps(c_row));                                    \
+                acc[i][1] = _mm256_add_ps(acc[i][1], _mm256_loadu_ps(c_row + 8));                                \
+            }                                                                                                    \
+            _mm256_storeu_ps(c_row, acc[i][0]);                                                                  \
+            _mm256_storeu_ps(c_row + 8, acc[i][1]);                                                              \
+        }                                                                                                        \
+    }
+
+#else
+
+// Portable C; with -msse4.2 (or NEON on arm64) the compiler vectorizes the j loop.
+#define GEMM_MR 4
+
+#define GEMM_LOAD_B_F32(b) (b)
+#define GEMM_LOAD_B_F16(b) (widen_f16(b_row, (b), GEMM_NR), b_row)
+
+#define GEMM_UKERNEL(name, b_t, load_b)                                                                  \
+    static void name(size_t kc, const float *__restrict a, const b_t *__restrict b,                      \
+                     float *__restrict c, size_t ldc, bool accumulate)                                   \
+    {                                                                                                    \
+        float acc0[GEMM_NR] = {0}, acc1[GEMM_NR] = {0}, acc2[GEMM_NR] = {0}, acc3[GEMM_NR] = {0};        \
+        float b_row[GEMM_NR];                                                                            \
+        (void)b_row;                                                                                     \
+        for (size_t k = 0; k < kc; ++k)                                                                  \
+        {                                                                                                \
+            const float *bk = load_b(b);                                                                 \
+            for (size_t j = 0; j < GEMM_NR; ++j)                                                         \
+            {                                                                                            \
+                acc0[j] += a[0] * bk[j];                                                                 \
+                acc1[j] += a[1] * bk[j];                                                                 \
+                acc2[j] += a[2] * bk[j];                                                                 \
+                acc3[j] += a[3] * bk[j];                                                                 \
+            }                                                                                            \
+            a += GEMM_MR;                                                                                \
+            b += GEMM_NR;                                                                                \
+        }                                                                                                \
+        float *acc[GEMM_MR] = {acc0, acc1, acc2, acc3};                                                  \
+        for (size_t i = 0; i < GEMM_MR; ++i)                                                             \
+            for (size_t j = 0; j < GEMM_NR; ++j)                                                         \
+                c[i * ldc + j] = (accumulate ? c[i * ldc + j] : 0.0f) + acc[i][j];                       \
+    }
+
+#endif
+
+// ---- FP16 widening ----
+
+#if defined(__F16C__)
+
+static void widen_f16(float *__restrict dst, const uint16_t *__restrict src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + i))));
+    for (; i < n; ++i)
+        dst[i] = _cvtsh_ss(src[i]);
+}
+
+#else
+
+static void widen_f16(float *__restrict dst, const uint16_t *__restrict src, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        dst[i] = f16_to_f32(src[i]);
+}
+
+#endif
+
+GEMM_UKERNEL(gemm_ukernel, float, GEMM_LOAD_B_F32)
+GEMM_UKERNEL(gemm_ukernel_f16, uint16_t, GEMM_LOAD_B_F16)
+
+_Static_assert(GEMM_MC % GEMM_MR == 0, "GEMM_MC must be a multiple of the microkernel rows");
+_Static_assert(GEMM_MR <= GEMM_MR_MAX, "GEMM_MR_MAX too small for this microkernel");
+
+// ---- Skinny GEMM ----
+// c[m, GEMM_NR] = a[m, K] x b[K, GEMM_NR] for m <= GEMM_SKINNY_MAX: a is read in place and
+// b is one packed panel. gemm_skinny_rows keeps M (a compile-time constant once inlined
+// into the switch below) rows of accumulators in registers over k in [k0, k1).
+
+#if defined(__AVX512F__)
+
+#define GEMM_SKINNY_MR 16
+#define GEMM_SKINNY_ROWS(X) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+#define GEMM_SKINNY_LOAD_B(b, f16, k) \
+    ((f16) ? GEMM_LOAD_B_F16((const uint16_t *)(b) + (k) * GEMM_NR) : GEMM_LOAD_B_F32((const float *)(b) + (k) * GEMM_NR))
+
+// Up to 8 rows, even and odd k go to two accumulator banks: M chains alone cannot hide the
+// FMA latency.
+static inline __attribute__((always_inline)) void gemm_skinny_rows(const size_t M, size_t k0, size_t k1,
+                                                                   const float *__restrict a, size_t lda,
+                                                                   const void *__restrict b, bool f16,
+                                                                   float *__restrict c, size_t ldc, bool accumulate)
+{
+    const bool banks = 2 * M <= GEMM_SKINNY_MR;
+    __m512 acc[GEMM_SKINNY_MR], odd[GEMM_SKINNY_MR];
+#pragma GCC unroll 16
+    for (size_t i = 0; i < M; ++i)
+        acc[i] = accumulate ? _mm512_loadu_ps(c + i * ldc) : _mm512_setzero_ps();
+    size_t k = k0;
+    if (banks)
+    {
+#pragma GCC unroll 8
+        for (size_t i = 0; i < M; ++i)
+            odd[i] = _mm512_setzero_ps();
+        for (; k + 2 <= k1; k += 2)
+        {
+            const __m512 b0 = GEMM_SKINNY_LOAD_B(b, f16, k), b1 = GEMM_SKINNY_LOAD_B(b, f16, k + 1);
+#pragma GCC unroll 8
+            for (size_t i = 0; i < M; ++i)
+            {
+                acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(a[i * lda + k]), b0, acc[i]);
+                odd[i] = _mm512_fmadd_ps(_mm512_set1_ps(a[i * lda + k + 1]), b1, odd[i]);
+            }
+        }
+    }
+    for (; k < k1; ++k)
+    {
+        const __m512 bv = GEMM_SKINNY_LOAD_B(b, f16, k);
+#pragma GCC unroll 16
+        for (size_t i = 0; i < M; ++i)
+            acc[i] = _mm512_fmadd_ps(_mm512_set1_ps(a[i * lda + k]), bv, acc[i]);
+    }
+#pragma GCC unroll 16
+    for (size_t i = 0; i < M; ++i)
+        _mm512_storeu_ps(c + i * ldc, banks ? _mm512_add_ps(acc[i], odd[i]) : acc[i]);
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+#define GEMM_SKINNY_MR 6
+#define GEMM_SKINNY_ROWS(X) X(1) X(2) X(3) X(4) X(5) X(6)
+
+static inline __attribute__((always_inline)) void gemm_skinny_rows(const size_t M, size_t k0, size_t k1,
+                                                                   const float *__restrict a, size_t lda,
+                                                                   const void *__restrict b, bool f16,
+                                                                   float *__restrict c, size_t ldc, bool accumulate)
+{
+    __m256 acc[GEMM_SKINNY_MR][2];
+#pragma GCC unroll 6
+    for (size_t i = 0; i < M; ++i)
+    {
+        acc[i][0] = accumulate ? _mm256_loadu_ps(c + i * ldc) : _mm256_setzero_ps();
+        acc[i][1] = accumulate ? _mm256_loadu_ps(c + i * ldc + 8) : _mm256_setzero_ps();
+    }
+    for (size_t k = k0; k < k1; ++k)
+    {
+        const uint16_t *b16 = (const uint16_t *)b + k * GEMM_NR;
+        const float *b32 = (const float *)b + k * GEMM_NR;
+        const __m256 b0 = f16 ? GEMM_LOAD_B_F16(b16) : GEMM_LOAD_B_F32(b32);
+        const __m256 b1 = f16 ? GEMM_LOAD_B_F16(b16 + 8) : GEMM_LOAD_B_F32(b32 + 8);
+#pragma GCC unroll 6
+        for (size_t i = 0; i < M; ++i)
+        {
+            const __m256 av = _mm256_broadcast_ss(a + i * lda + k);
+            acc[i][0] = _mm256_fmadd_ps(av, b0, acc[i][0]);
+            acc[i][1] = _mm256_fmadd_ps(av, b1, acc[i][1]);
+        }
+    }
+#pragma GCC unroll 6
+    for (size_t i = 0; i < M; ++i)
+    {
+        _mm256_storeu_ps(c + i * ldc, acc[i][0]);
+        _mm256_storeu_ps(c + i * ldc + 8, acc[i][1]);
+    }
+}
+
+#else
+
+#define GEMM_SKINNY_MR 4
+#define GEMM_SKINNY_ROWS(X) X(1) X(2) X(3) X(4)
+
+static inline void gemm_skinny_rows(const size_t M, size_t k0, size_t k1,
+                                    const float *__restrict a, size_t lda,
+                                    const void *__restrict b, bool f16,
+                                    float *__restrict c, size_t ldc, bool accumulate)
+{
+    float acc[GEMM_SKINNY_MR][GEMM_NR], b_row[GEMM_NR];
+    for (size_t i = 0; i < M; ++i)
+        for (size_t j = 0; j < GEMM_NR; ++j)
+            acc[i][j] = accumulate ? c[i * ldc + j] : 0.0f;
+    for (size_t k = k0; k < k1; ++k)
+    {
+        const float *bk = (const float *)b + k * GEMM_NR;
+        if (f16)
+            bk = GEMM_LOAD_B_F16((const uint16_t *)b + k * GEMM_NR);
+        for (size_t i = 0; i < M; ++i)
+            for (size_t j = 0; j < GEMM_NR; ++j)
+                acc[i][j] += a[i * lda + k] * bk[j];
+    }
+    for (size_t i = 0; i < M; ++i)
+        memcpy(c + i * ldc, acc[i], sizeof(acc[i]));
+}
+
+#endif
+
+// With more rows than fit in registers, K is walked in GEMM_KC blocks and the row groups
+// take turns on each block, so b still crosses the memory bus once (later groups hit L1).
+static inline void gemm_skinny_any(size_t m, size_t K, const float *__restrict a, size_t lda,
+                                   const void *__restrict b, bool f16, float *__restrict c, size_t ldc)
+{
+    const size_t kb = m <= GEMM_SKINNY_MR ? K : GEMM_KC;
+    for (size_t k0 = 0; k0 < K; k0 += kb)
+    {
+        const size_t k1 = k0 + kb < K ? k0 + kb : K;
+        for (size_t i0 = 0; i0 < m; i0 += GEMM_SKINNY_MR)
+        {
+            const float *a_rows = a + i0 * lda;
+            float *c_rows = c + i0 * ldc;
+            switch (m - i0 < GEMM_SKINNY_MR ? m - i0 : GEMM_SKINNY_MR)
+            {
+#define GEMM_SKINNY_CASE(n)                                                       \
+    case n:                                                                       \
+        gemm_skinny_rows(n, k0, k1, a_rows, lda, b, f16, c_rows, ldc, k0 > 0);   \
+        break;
+                GEMM_SKINNY_ROWS(GEMM_SKINNY_CASE)
+#undef GEMM_SKINNY_CASE
+            }
+        }
+    }
+}
+
+static void gemm_skinny_panel(size_t m, size_t K, const float *__restrict a, size_t lda,
+                              const float *__restrict b, float *__restrict c, size_t ldc)
+{
+    gemm_skinny_any(m, K, a, lda, b, false, c, ldc);
+}
+
+static void gemm_skinny_panel_f16(size_t m, size_t K, const float *__restrict a, size_t lda,
+                                  const uint16_t *__restrict b, float *__restrict c, size_t ldc)
+{
+    gemm_skinny_any(m, K, a, lda, b, true, c, ldc);
+}
+
+_Static_assert(GEMM_SKINNY_MR <= GEMM_SKINNY_MAX, "GEMM_SKINNY_MAX too small for this kernel");
+
+// ---- INT8 GEMM microkernels ----
+// c[MR, GEMM_NR] = a[kq, MR, 4] x b[kq, GEMM_NR, 4] in int32, over all of K (kq = K / 4):
+// each 4-byte group is 4 consecutive k of one row of A or one column of B (gemm_quantize_b).
+// Both operands are int8 in [-127, 127]. Every variant computes the exact sum, so results
+// do not depend on the CPU.
+
+static inline int32_t load_a4(const int8_t *a)
+{
+    int32_t v;
+    memcpy(&v, a, sizeof(v));
+    return v;
+}
+
+#if defined(__AVX512F__) && defined(__AVX512VNNI__)
+
+// vpdpbusd multiplies u8 by s8: a is biased by +128 (xor of the sign bits) and the
+// accumulators start at -128 * column sum of b to take the bias back out.
+#define GEMM_I8_ROW(i) c##i = _mm512_dpbusd_epi32(c##i, _mm512_set1_epi32(load_a4(a + 4 * (i)) ^ (int32_t)0x80808080), bv)
+
+static void gemm_ukernel_i8(size_t kq, const int8_t *__restrict a, const int8_t *__restrict b,
+                            const int32_t *__restrict b_sum, int32_t *__restrict c)
+{
+    const __m512i init = _mm512_sub_epi32(_mm512_setzero_si512(), _mm512_slli_epi32(_mm512_load_si512(b_sum), 7));
+    __m512i c0 = init, c1 = init, c2 = init, c3 = init, c4 = init, c5 = init;
+    __m512i c6 = init, c7 = init, c8 = init, c9 = init, c10 = init, c11 = init;
+
+    for (size_t k = 0; k < kq; ++k)
+    {
+        const __m512i bv = _mm512_load_si512(b);
+        GEMM_I8_ROW(0);
+        GEMM_I8_ROW(1);
+        GEMM_I8_ROW(2);
+        GEMM_I8_ROW(3);
+        GEMM_I8_ROW(4);
+        GEMM_I8_ROW(5);
+        GEMM_I8_ROW(6);
+        GEMM_I8_ROW(7);
+        GEMM_I8_ROW(8);
+        GEMM_I8_ROW(9);
+        GEMM_I8_ROW(10);
+        GEMM_I8_ROW(11);
+        a += 4 * GEMM_MR;
+        b += 4 * GEMM_NR;
+    }
+
+    const __m512i acc[GEMM_MR] = {c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11};
+    for (size_t i = 0; i < GEMM_MR; ++i)
+        _mm512_store_si512(c + i * GEMM_NR, acc[i]);
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+// No u8 x s8 dot product: |a| x (b with the sign of a) through vpmaddubsw. A pair of
+// products is at most 2 * 127 * 127, so the int16 intermediate never saturates.
+// vpsignb only exists for 256-bit vectors, so the AVX-512 build runs this 6-row body
+// twice over its 12-row panels (the b panel is in L1 for the second pass).
+#define GEMM_I8_ROW(i)                                                                        \
+    do                                                                                       \
+    {                                                                                        \
+        const __m256i av = _mm256_set1_epi32(load_a4(a + 4 * (i)));                          \
+        const __m256i aa = _mm256_abs_epi8(av);                                              \
+        const __m256i p0 = _mm256_maddubs_epi16(aa, _mm256_sign_epi8(b0, av));               \
+        const __m256i p1 = _mm256_maddubs_epi16(aa, _mm256_sign_epi8(b1, av));               \
+        c##i##0 = _mm256_add_epi32(c##i##0, _mm256_madd_epi16(p0, ones));                    \
+        c##i##1 = _mm256_add_epi32(c##i##1, _mm256_madd_epi16(p1, ones));                    \
+    } while (0)
+
+// rows [0, 6) of a panel with `lda` bytes per k group
+static inline void gemm_i8_rows6(size_t kq, const int8_t *__restrict a, size_t lda, const int8_t *__restrict b,
+                                 int32_t *__restrict c)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+    __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+    __m256i c40 = _mm256_setzero_si256(), c41 = _mm256_setzero_si256();
+    __m256i c50 = _mm256_setzero_si256(), c51 = _mm256_setzero_si256();
+
+    for (size_t k = 0; k < kq; ++k)
+    {
+        const __m256i b0 = _mm256_load_si256((const __m256i *)b);
+        const __m256i b1 = _mm256_load_si256((const __m256i *)(b + 32));
+        GEMM_I8_ROW(0);
+        GEMM_I8_ROW(1);
+        GEMM_I8_ROW(2);
+        GEMM_I8_ROW(3);
+        GEMM_I8_ROW(4);
+        GEMM_I8_ROW(5);
+        a += lda;
+        b += 4 * GEMM_NR;
+    }
+
+    const __m256i acc[6][2] = {{c00, c01}, {c10, c11}, {c20, c21}, {c30, c31}, {c40, c41}, {c50, c51}};
+    for (size_t i = 0; i < 6; ++i)
+    {
+        _mm256_store_si256((__m256i *)(c + i * GEMM_NR), acc[i][0]);
+        _mm256_store_si256((__m256i *)(c + i * GEMM_NR + 8), acc[i][1]);
+    }
+}
+
+static void gemm_ukernel_i8(size_t kq, const int8_t *__restrict a, const int8_t *__restrict b,
+                            const int32_t *__restrict b_sum, int32_t *__restrict c)
+{
+    (void)b_sum;
+    for (size_t i = 0; i < GEMM_MR; i += 6)
+        gemm_i8_rows6(kq, a + 4 * i, 4 * GEMM_MR, b, c + i * GEMM_NR);
+}
+
+_Static_assert(GEMM_MR % 6 == 0, "the int8 kernel runs 6 rows at a time");
+
+#else
+
+static void gemm_ukernel_i8(size_t kq, const int8_t *__restrict a, const int8_t *__restrict b,
+                            const int32_t *__restrict b_sum, int32_t *__restrict c)
+{
+    (void)b_sum;
+    int32_t acc[GEMM_MR][GEMM_NR] = {{0}};
+    for (size_t k = 0; k < kq; ++k)
+    {
+        for (size_t i = 0; i < GEMM_MR; ++i)
+            for (size_t j = 0; j < GEMM_NR; ++j)
+                acc[i][j] += a[4 * i] * b[4 * j] + a[4 * i + 1] * b[4 * j + 1] +
+                             a[4 * i + 2] * b[4 * j + 2] + a[4 * i + 3] * b[4 * j + 3];
+        a += 4 * GEMM_MR;
+        b += 4 * GEMM_NR;
+    }
+    memcpy(c, acc, sizeof(acc));
+}
+
+#endif
+
+// ---- Transpose ----
+// dst[j, i] = src[i, j] for one cache tile: full blocks are transposed in registers,
+// 16x16 with AVX-512 and 8x8 with AVX2 (unpack, 64-bit shuffle, then lane shuffles);
+// the ragged edges are copied element by element.
+
+#if defined(__AVX512F__)
+
+#define TRANSPOSE_B 16
+
+static inline void transpose_block(float *__restrict dst, size_t ldd, const float *__restrict src, size_t lds)
+{
+    __m512 r[16], t[16];
+    for (size_t i = 0; i < 16; ++i)
+        r[i] = _mm512_loadu_ps(src + i * lds);
+    for (size_t i = 0; i < 16; i += 2)
+    {
+        t[i] = _mm512_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm512_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (size_t i = 0; i < 16; i += 4)
+    {
+        r[i] = _mm512_shuffle_ps(t[i], t[i + 2], 0x44);
+        r[i + 1] = _mm512_shuffle_ps(t[i], t[i + 2], 0xee);
+        r[i + 2] = _mm512_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+        r[i + 3] = _mm512_shuffle_ps(t[i + 1], t[i + 3], 0xee);
+    }
+    for (size_t i = 0; i < 16; i += 8)
+        for (size_t j = 0; j < 4; ++j)
+        {
+            t[i + j] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0x88);
+            t[i + j + 4] = _mm512_shuffle_f32x4(r[i + j], r[i + j + 4], 0xdd);
+        }
+    for (size_t j = 0; j < 8; ++j)
+    {
+        r[j] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0x88);
+        r[j + 8] = _mm512_shuffle_f32x4(t[j], t[j + 8], 0xdd);
+    }
+    for (size_t i = 0; i < 16; ++i)
+        _mm512_storeu_ps(dst + i * ldd, r[i]);
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+#define TRANSPOSE_B 8
+
+static inline void transpose_block(float *__restrict dst, size_t ldd, const float *__restrict src, size_t lds)
+{
+    __m256 r[8], t[8];
+    for (size_t i = 0; i < 8; ++i)
+        r[i] = _mm256_loadu_ps(src + i * lds);
+    for (size_t i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_ps(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_ps(r[i], r[i + 1]);
+    }
+    for (size_t i = 0; i < 8; i += 4)
+    {
+        r[i] = _mm256_shuffle_ps(t[i], t[i + 2], 0x44);
+        r[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], 0xee);
+        r[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0x44);
+        r[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], 0xee);
+    }
+    for (size_t j = 0; j < 4; ++j)
+    {
+        t[j] = _mm256_permute2f128_ps(r[j], r[j + 4], 0x20);
+        t[j + 4] = _mm256_permute2f128_ps(r[j], r[j + 4], 0x31);
+    }
+    for (size_t i = 0; i < 8; ++i)
+        _mm256_storeu_ps(dst + i * ldd, t[i]);
+}
+
+#else
+
+// Portable C: an 8x8 block of scalar copies, which keeps both sides within a few lines
+#define TRANSPOSE_B 8
+
+static inline void transpose_block(float *__restrict dst, size_t ldd, const float *__restrict src, size_t lds)
+{
+    for (size_t i = 0; i < 8; ++i)
+        for (size_t j = 0; j < 8; ++j)
+            dst[j * ldd + i] = src[i * lds + j];
+}
+
+#endif
+
+static void transpose(float *__restrict dst, size_t ldd, const float *__restrict src, size_t lds,
+                      size_t rows, size_t cols)
+{
+    const size_t rows_b = rows / TRANSPOSE_B * TRANSPOSE_B, cols_b = cols / TRANSPOSE_B * TRANSPOSE_B;
+    for (size_t i = 0; i < rows_b; i += TRANSPOSE_B)
+    {
+        for (size_t j = 0; j < cols_b; j += TRANSPOSE_B)
+            transpose_block(dst + j * ldd + i, ldd, src + i * lds + j, lds);
+        for (size_t j = cols_b; j < cols; ++j)
+            for (size_t ii = i; ii < i + TRANSPOSE_B; ++ii)
+                dst[j * ldd + ii] = src[ii * lds + j];
+    }
+    for (size_t i = rows_b; i < rows; ++i)
+        for (size_t j = 0; j < cols; ++j)
+            dst[j * ldd + i] = src[i * lds + j];
+}
+
+// ---- Row kernels ----
+// Plain loops: each ISA build vectorizes them with its own register width.
+
+// LayerNorm: one pass for the statistics, one for the output, no temporaries.
+// The sums are taken over x - x[0] (shifted data), which keeps the single-pass
+// variance sum((x - K)^2) / n - mean(x - K)^2 free of cancellation when |mean| >> std.
+// out may alias x (in-place normalization), so neither is restrict.
+
+#if defined(__AVX512F__)
+
+static inline float hsum(__m512 v)
+{
+    return _mm512_reduce_add_ps(v);
+}
+
+static void layer_norm_row_any(float *out, const float *x,
+                               const float *__restrict gamma, const float *__restrict beta,
+                               size_t n, float eps)
+{
+    const float shift = x[0];
+    const __m512 vshift = _mm512_set1_ps(shift);
+    __m512 s0 = _mm512_setzero_ps(), s1 = _mm512_setzero_ps();
+    __m512 q0 = _mm512_setzero_ps(), q1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        const __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(x + i), vshift);
+        const __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(x + i + 16), vshift);
+        s0 = _mm512_add_ps(s0, d0);
+        s1 = _mm512_add_ps(s1, d1);
+        q0 = _mm512_fmadd_ps(d0, d0, q0);
+        q1 = _mm512_fmadd_ps(d1, d1, q1);
+    }
+    float sum = hsum(_mm512_add_ps(s0, s1)), sq = hsum(_mm512_add_ps(q0, q1));
+    for (; i < n; ++i)
+    {
+        const float d = x[i] - shift;
+        sum += d;
+        sq += d * d;
+    }
+
+    const float mean_d = sum / (float)n;
+    const float var = fmaxf(sq / (float)n - mean_d * mean_d, 0.0f);
+    const float inv_std = 1.0f / sqrtf(var + eps);
+    const __m512 vmean = _mm512_set1_ps(shift + mean_d), vinv = _mm512_set1_ps(inv_std);
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        const __m512 norm = _mm512_mul_ps(_mm512_sub_ps(_mm512_loadu_ps(x + i), vmean), vinv);
+        _mm512_storeu_ps(out + i, _mm512_fmadd_ps(norm, _mm512_loadu_ps(gamma + i), _mm512_loadu_ps(beta + i)));
+    }
+    for (; i < n; ++i)
+        out[i] = (x[i] - (shift + mean_d)) * inv_std * gamma[i] + beta[i];
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+static inline float hsum(__m256 v)
+{
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+    lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+    return _mm_cvtss_f32(lo);
+}
+
+static void layer_norm_row_any(float *out, const float *x,
+                               const float *__restrict gamma, const float *__restrict beta,
+                               size_t n, float eps)
+{
+    const float shift = x[0];
+    const __m256 vshift = _mm256_set1_ps(shift);
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+    __m256 q0 = _mm256_setzero_ps(), q1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(x + i), vshift);
+        const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(x + i + 8), vshift);
+        s0 = _mm256_add_ps(s0, d0);
+        s1 = _mm256_add_ps(s1, d1);
+        q0 = _mm256_fmadd_ps(d0, d0, q0);
+        q1 = _mm256_fmadd_ps(d1, d1, q1);
+    }
+    float sum = hsum(_mm256_add_ps(s0, s1)), sq = hsum(_mm256_add_ps(q0, q1));
+    for (; i < n; ++i)
+    {
+        const float d = x[i] - shift;
+        sum += d;
+        sq += d * d;
+    }
+
+    const float mean_d = sum / (float)n;
+    const float var = fmaxf(sq / (float)n - mean_d * mean_d, 0.0f);
+    const float inv_std = 1.0f / sqrtf(var + eps);
+    const __m256 vmean = _mm256_set1_ps(shift + mean_d), vinv = _mm256_set1_ps(inv_std);
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        const __m256 norm = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + i), vmean), vinv);
+        _mm256_storeu_ps(out + i, _mm256_fmadd_ps(norm, _mm256_loadu_ps(gamma + i), _mm256_loadu_ps(beta + i)));
+    }
+    for (; i < n; ++i)
+        out[i] = (x[i] - (shift + mean_d)) * inv_std * gamma[i] + beta[i];
+}
+
+#else
+
+static void layer_norm_row_any(float *out, const float *x,
+                               const float *__restrict gamma, const float *__restrict beta,
+                               size_t n, float eps)
+{
+    const float shift = x[0];
+    float sum = 0.0f, sq = 0.0f;
+    for (size_t i = 0; i < n; ++i)
+    {
+        const float d = x[i] - shift;
+        sum += d;
+        sq += d * d;
+    }
+
+    const float mean_d = sum / (float)n;
+    const float mean = shift + mean_d;
+    const float var = fmaxf(sq / (float)n - mean_d * mean_d, 0.0f);
+    const float inv_std = 1.0f / sqrtf(var + eps);
+    for (size_t i = 0; i < n; ++i)
+        out[i] = (x[i] - mean) * inv_std * gamma[i] + beta[i];
+}
+
+#endif
+
+// ---- Vector math ----
+// Branch-free scalar formulations written so that the loops calling them vectorize
+// (-O3 -ffast-math) at each build's register width: polynomials, selects instead of
+// branches, and exponent arithmetic on the float bits. Max errors, measured against
+// libm in double precision by kernels_test.c over the whole useful range:
+//   vexpf   <= 2 ULP  (flushes to 0 below -87.3, saturates above 88.7)
+//   vtanhf  <= 2 ULP
+//   verff   <= 3 ULP
+// -ffast-math may reassociate, so nothing here relies on (a + C) - C rounding tricks.
+
+static inline float vexpf(float x)
+{
+    const float xc = fminf(fmaxf(x, -87.3f), 88.7f);
+    // x = n ln2 + r, |r| <= ln2 / 2. The reduction is done in double: the usual float
+    // hi/lo split of ln2 does not survive -ffast-math, which folds it back together.
+    const int32_t ni = (int32_t)floorf(xc * 1.44269504088896341f + 0.5f);
+    const float r = (float)((double)xc - (double)ni * 0.6931471805599453);
+    // Cephes minimax polynomial for e^r
+    float p = 1.9875691500e-4f;
+    p = p * r + 1.3981999507e-3f;
+    p = p * r + 8.3334519073e-3f;
+    p = p * r + 4.1665795894e-2f;
+    p = p * r + 1.6666665459e-1f;
+    p = p * r + 5.0000001201e-1f;
+    float y = p * r * r + r + 1.0f;
+    // y * 2^n through the exponent bits
+    int32_t bits;
+    memcpy(&bits, &y, sizeof(bits));
+    bits += ni << 23;
+    memcpy(&y, &bits, sizeof(y));
+    return x < -87.3f ? 0.0f : y;
+}
+
+static inline float vtanhf(float x)
+{
+    const float ax = fabsf(x);
+    // |x| < 0.625: odd Cephes polynomial, no cancellation near 0
+    const float z = x * x;
+    float p = -5.70498872745e-3f;
+    p = p * z + 2.06390887954e-2f;
+    p = p * z - 5.37397155531e-2f;
+    p = p * z + 1.33314422036e-1f;
+    p = p * z - 3.33332819422e-1f;
+    const float small = x + x * z * p;
+    // otherwise 1 - 2 / (e^2|x| + 1); tanh(9) rounds to 1 already
+    const float e = vexpf(2.0f * fminf(ax, 9.0f));
+    const float large = 1.0f - 2.0f / (e + 1.0f);
+    return ax < 0.625f ? small : (x < 0.0f ? -large : large);
+}
+
+static inline float verff(float x)
+{
+    const float ax = fabsf(x);
+    // |x| < 0.75: Maclaurin series up to x^17 (truncation < 1e-9 relative)
+    const float z = x * x;
+    float p = 1.0f / 685440.0f;
+    p = p * z - 1.0f / 75600.0f;
+    p = p * z + 1.0f / 9360.0f;
+    p = p * z - 1.0f / 1320.0f;
+    p = p * z + 1.0f / 216.0f;
+    p = p * z - 1.0f / 42.0f;
+    p = p * z + 1.0f / 10.0f;
+    p = p * z - 1.0f / 3.0f;
+    p = p * z + 1.0f;
+    const float small = 1.12837916709551257f * x * p;
+    // otherwise 1 - erfc(|x|), erfc from the Chebyshev fit of Numerical Recipes
+    // (relative error < 1.2e-7); erfc(10) is far below float resolution of 1
+    const float t = 1.0f / (1.0f + 0.5f * fminf(ax, 10.0f));
+    float q = 0.17087277f;
+    q = q * t - 0.82215223f;
+    q = q * t + 1.48851587f;
+    q = q * t - 1.13520398f;
+    q = q * t + 0.27886807f;
+    q = q * t - 0.18628806f;
+    q = q * t + 0.09678418f;
+    q = q * t + 0.37409196f;
+    q = q * t + 1.00002368f;
+    q = q * t - 1.26551223f;
+    const float erfc = t * vexpf(q - ax * ax);
+    const float large = 1.0f - erfc;
+    return ax < 0.75f ? small : (x < 0.0f ? -large : large);
+}
+
+static void softmax_row(float *x, size_t n)
+{
+    float max = -FLT_MAX;
+    for (size_t i = 0; i < n; ++i)
+        max = fmaxf(max, x[i]);
+
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i)
+    {
+        x[i] = vexpf(x[i] - max);
+        sum += x[i];
+    }
+
+    const float scale = 1.0f / sum;
+    for (size_t i = 0; i < n; ++i)
+        x[i] *= scale;
+}
+
+static void exp_inplace(float *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] = vexpf(x[i]);
+}
+
+static void tanh_inplace(float *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] = vtanhf(x[i]);
+}
+
+static void erf_inplace(float *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        x[i] = verff(x[i]);
+}
+
+static void gelu_inplace(float *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const float v = x[i];
+        x[i] = 0.5f * v * (1.0f + vtanhf(0.7978845608028654f * (v + 0.044715f * v * v * v)));
+    }
+}
+
+static void gelu_erf_inplace(float *x, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        const float v = x[i];
+        x[i] = 0.5f * v * (1.0f + verff(0.7071067811865476f * v));
+    }
+}
+
+static float dot(const float *__restrict a, const float *__restrict b, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+// ---- Fused attention ----
+// Query rows are processed ATTN_BQ at a time against key tiles of ATTN_BK. Each key
+// tile is transposed once into kt[d][ATTN_BK] so both inner loops (scores over keys,
+// accumulation over the head dimension) run over contiguous memory.
+
+#define ATTN_BQ 16
+#define ATTN_BK 64
+// score of a masked key: exp() of it flushes to 0; finite because of -ffast-math
+#define ATTN_MASKED -1e30f
+
+static void attention_any(const float *q, size_t ldq, size_t n_q,
+                          const float *k, const float *v, size_t ldkv, size_t n_kv,
+                          const float *mask, float scale, float *o, size_t ldo, size_t d)
+{
+    float kt[KERNELS_ATTN_MAX_D * ATTN_BK];
+    float acc[ATTN_BQ][KERNELS_ATTN_MAX_D];
+    float row_max[ATTN_BQ], row_sum[ATTN_BQ];
+    float s[ATTN_BK];
+
+    for (size_t i0 = 0; i0 < n_q; i0 += ATTN_BQ)
+    {
+        const size_t bq = n_q - i0 < ATTN_BQ ? n_q - i0 : ATTN_BQ;
+        for (size_t i = 0; i < bq; ++i)
+        {
+            row_max[i] = -FLT_MAX;
+            row_sum[i] = 0.0f;
+            for (size_t c = 0; c < d; ++c)
+                acc[i][c] = 0.0f;
+        }
+
+        for (size_t j0 = 0; j0 < n_kv; j0 += ATTN_BK)
+        {
+            const size_t bk = n_kv - j0 < ATTN_BK ? n_kv - j0 : ATTN_BK;
+            for (size_t j = 0; j < bk; ++j)
+                for (size_t c = 0; c < d; ++c)
+                    kt[c * ATTN_BK + j] = k[(j0 + j) * ldkv + c];
+
+            for (size_t i = 0; i < bq; ++i)
+            {
+                const float *q_row = q + (i0 + i) * ldq;
+                for (size_t j = 0; j < bk; ++j)
+                    s[j] = 0.0f;
+                for (size_t c = 0; c < d; ++c)
+                {
+                    const float qc = q_row[c] * scale;
+                    for (size_t j = 0; j < bk; ++j)
+                        s[j] += qc * kt[c * ATTN_BK + j];
+                }
+                if (mask)
+                    for (size_t j = 0; j < bk; ++j)
+                        s[j] = mask[j0 + j] == 0.0f ? ATTN_MASKED : s[j];
+
+                float tile_max = row_max[i];
+                for (size_t j = 0; j < bk; ++j)
+                    tile_max = fmaxf(tile_max, s[j]);
+
+                // rescale what was accumulated under the previous max
+                const float correction = vexpf(row_max[i] - tile_max);
+                row_max[i] = tile_max;
+                float tile_sum = 0.0f;
+                for (size_t j = 0; j < bk; ++j)
+                {
+                    s[j] = vexpf(s[j] - tile_max);
+                    tile_sum += s[j];
+                }
+                row_sum[i] = row_sum[i] * correction + tile_sum;
+
+                float *acc_row = acc[i];
+                for (size_t c = 0; c < d; ++c)
+                    acc_row[c] *= correction;
+                for (size_t j = 0; j < bk; ++j)
+                {
+                    const float p = s[j];
+                    const float *v_row = v + (j0 + j) * ldkv;
+                    for (size_t c = 0; c < d; ++c)
+                        acc_row[c] += p * v_row[c];
+                }
+            }
+        }
+
+        for (size_t i = 0; i < bq; ++i)
+        {
+            const float inv = 1.0f / row_sum[i];
+            float *o_row = o + (i0 + i) * ldo;
+            for (size_t c = 0; c < d; ++c)
+                o_row[c] = acc[i][c] * inv;
+        }
+    }
+}
+
+// ---- Shape-specialized kernels ----
+// With -DKERNELS_FIXED the Makefile generates kernels_fixed.h (scripts/gen_kernels.py):
+// layer norm and attention fully unrolled for the model's hidden size, head size and
+// longest sequence, so no loop bound or tail is left to the runtime. They are written
+// against the vf_* layer below; the table entries check the shape and fall back to the
+// general kernels above for any other model.
+
+#if defined(KERNELS_FIXED)
+
+#if defined(__AVX512F__)
+
+typedef __m512 vf_t;
+#define VF_W 16
+#define vf_load _mm512_loadu_ps
+#define vf_store _mm512_storeu_ps
+#define vf_set1 _mm512_set1_ps
+#define vf_zero _mm512_setzero_ps
+#define vf_add _mm512_add_ps
+#define vf_sub _mm512_sub_ps
+#define vf_mul _mm512_mul_ps
+#define vf_fmadd _mm512_fmadd_ps
+#define vf_hsum hsum
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+typedef __m256 vf_t;
+#define VF_W 8
+#define vf_load _mm256_loadu_ps
+#define vf_store _mm256_storeu_ps
+#define vf_set1 _mm256_set1_ps
+#define vf_zero _mm256_setzero_ps
+#define vf_add _mm256_add_ps
+#define vf_sub _mm256_sub_ps
+#define vf_mul _mm256_mul_ps
+#define vf_fmadd _mm256_fmadd_ps
+#define vf_hsum hsum
+
+#elif defined(__SSE2__)
+
+typedef __m128 vf_t;
+#define VF_W 4
+#define vf_load _mm_loadu_ps
+#define vf_store _mm_storeu_ps
+#define vf_set1 _mm_set1_ps
+#define vf_zero _mm_setzero_ps
+#define vf_add _mm_add_ps
+#define vf_sub _mm_sub_ps
+#define vf_mul _mm_mul_ps
+#define vf_fmadd(a, b, c) _mm_add_ps(_mm_mul_ps(a, b), c)
+
+static inline float vf_hsum(__m128 v)
+{
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+#endif
+
+#if defined(VF_W)
+#include "kernels_fixed.h"
+#endif
+
+#endif
+
+static void layer_norm_row(float *out, const float *x,
+                           const float *__restrict gamma, const float *__restrict beta,
+                           size_t n, float eps)
+{
+#if defined(KERNELS_FIXED_HIDDEN)
+    if (n == KERNELS_FIXED_HIDDEN)
+    {
+        layer_norm_row_fixed(out, x, gamma, beta, eps);
+        return;
+    }
+#endif
+    layer_norm_row_any(out, x, gamma, beta, n, eps);
+}
+
+static void attention(const float *q, size_t ldq, size_t n_q,
+                      const float *k, const float *v, size_t ldkv, size_t n_kv,
+                      const float *mask, float scale, float *o, size_t ldo, size_t d)
+{
+#if defined(KERNELS_FIXED_HEAD_DIM)
+    if (d == KERNELS_FIXED_HEAD_DIM && n_kv <= KERNELS_FIXED_MAX_TOKENS)
+    {
+        attention_fixed(q, ldq, n_q, k, v, ldkv, n_kv, mask, scale, o, ldo);
+        return;
+    }
+#endif
+    attention_any(q, ldq, n_q, k, v, ldkv, n_kv, mask, scale, o, ldo, d);
+}
+
+const kernels_t m_cat(kernels_, KERNELS_ISA) = {
+    .name = m_str(KERNELS_ISA),
+    .gemm_mr = GEMM_MR,
+    .gemm_ukernel = gemm_ukernel,
+    .gemm_ukernel_f16 = gemm_ukernel_f16,
+    .widen_f16 = widen_f16,
+    .gemm_ukernel_i8 = gemm_ukernel_i8,
+    .gemm_skinny_panel = gemm_skinny_panel,
+    .gemm_skinny_panel_f16 = gemm_skinny_panel_f16,
+    .transpose = transpose,
+    .layer_norm_row = layer_norm_row,
+    .softmax_row = softmax_row,
+    .exp = exp_inplace,
+    .tanh = tanh_inplace,
+    .erf = erf_inplace,
+    .gelu = gelu_inplace,
+    .gelu_erf = gelu_erf_inplace,
+    .dot = dot,
+    .attention = attention,
+};
@@ -0,0 +1,350 @@
+#include "kernels.h"
+#include "gemm.h"
+#include "f16.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+
+// Accuracy of the vector math kernels against libm in double precision, for every
+// kernel variant this CPU supports. The bounds match the ones documented in kernels.h.
+
+#define N_SAMPLES 200000
+
+static float ulp_error(float got, double want)
+{
+    const float ref = (float)want;
+    const float ulp = nextafterf(fabsf(ref), INFINITY) - fabsf(ref);
+    return (float)(fabs((double)got - want) / ulp);
+}
+
+// linear samples over [lo, hi] plus log-spaced ones near 0 (both signs when lo < 0)
+static size_t fill_samples(float *x, float lo, float hi)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < N_SAMPLES; i++)
+        x[n++] = lo + (hi - lo) * (float)i / (N_SAMPLES - 1);
+    if (lo < 0.0f)
+        for (size_t i = 0; i < N_SAMPLES / 2; i++)
+        {
+            const float v = powf(10.0f, -6.0f + 6.0f * (float)i / (N_SAMPLES / 2));
+            x[n++] = v;
+            x[n++] = -v;
+        }
+    return n;
+}
+
+static float max_ulp(void (*fn)(float *, size_t), double (*ref)(double), float lo, float hi, float *worst_x)
+{
+    static float x[2 * N_SAMPLES], y[2 * N_SAMPLES];
+    const size_t n = fill_samples(x, lo, hi);
+    memcpy(y, x, n * sizeof(float));
+    fn(y, n);
+
+    float worst = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        const double want = ref((double)x[i]);
+        if (fabs(want) < FLT_MIN) // subnormal results are not covered by the bound
+            continue;
+        const float err = ulp_error(y[i], want);
+        if (err > worst)
+        {
+            worst = err;
+            *worst_x = x[i];
+        }
+    }
+    return worst;
+}
+
+static double gelu_tanh_ref(double x)
+{
+    return 0.5 * x * (1.0 + tanh(0.7978845608028654 * (x + 0.044715 * x * x * x)));
+}
+
+static double gelu_erf_ref(double x)
+{
+    return 0.5 * x * (1.0 + erf(x / sqrt(2.0)));
+}
+
+// GELU goes through 0 and cancels for x << 0, so it is checked in absolute terms
+static double max_abs_error(void (*fn)(float *, size_t), double (*ref)(double))
+{
+    static float x[N_SAMPLES], y[N_SAMPLES];
+    for (size_t i = 0; i < N_SAMPLES; i++)
+        x[i] = -10.0f + 20.0f * (float)i / (N_SAMPLES - 1);
+    memcpy(y, x, sizeof(x));
+    fn(y, N_SAMPLES);
+
+    double worst = 0.0;
+    for (size_t i = 0; i < N_SAMPLES; i++)
+        worst = fmax(worst, fabs((double)y[i] - ref((double)x[i])) / fmax(1.0, fabs((double)x[i])));
+    return worst;
+}
+
+void test_vector_math(const kernels_t *kern)
+{
+    float at;
+    float exp_ulp = max_ulp(kern->exp, exp, -87.0f, 88.0f, &at);
+    printf("  %-8s exp  max %.2f ULP at %g\n", kern->name, exp_ulp, at);
+    float tanh_ulp = max_ulp(kern->tanh, tanh, -10.0f, 10.0f, &at);
+    printf("  %-8s tanh max %.2f ULP at %g\n", kern->name, tanh_ulp, at);
+    float erf_ulp = max_ulp(kern->erf, erf, -5.0f, 5.0f, &at);
+    printf("  %-8s erf  max %.2f ULP at %g\n", kern->name, erf_ulp, at);
+    assert(exp_ulp <= 2.0f);
+    assert(tanh_ulp <= 2.0f);
+    assert(erf_ulp <= 3.0f);
+
+    double gelu_err = max_abs_error(kern->gelu, gelu_tanh_ref);
+    double gelu_erf_err = max_abs_error(kern->gelu_erf, gelu_erf_ref);
+    printf("  %-8s gelu max err %.2e, gelu_erf max err %.2e (relative to max(1, |x|))\n",
+           kern->name, gelu_err, gelu_erf_err);
+    assert(gelu_err < 1e-6);
+    assert(gelu_erf_err < 1e-6);
+
+    // exp flushes instead of producing garbage outside its range
+    float edge[4] = {-1e30f, -100.0f, 0.0f, 1.0f};
+    kern->exp(edge, 4);
+    assert(edge[0] == 0.0f && edge[1] == 0.0f && edge[2] == 1.0f);
+}
+
+void test_softmax(const kernels_t *kern)
+{
+    float x[100];
+    double want[100], sum = 0.0;
+    for (size_t i = 0; i < 100; i++)
+    {
+        x[i] = 40.0f * sinf((float)i); // large spread: needs the max subtraction
+        sum += exp((double)x[i]);
+    }
+    for (size_t i = 0; i < 100; i++)
+        want[i] = exp((double)x[i]) / sum;
+    x[7] = -1e30f; // masked score
+    want[7] = 0.0;
+
+    kern->softmax_row(x, 100);
+    for (size_t i = 0; i < 100; i++)
+        assert(fabs((double)x[i] - want[i]) < 1e-6);
+}
+
+// every half value, against the scalar reference (bit-exact, NaN payloads included)
+void test_widen_f16(const kernels_t *kern)
+{
+    static uint16_t h[65536];
+    static float got[65536];
+    for (uint32_t i = 0; i < 65536; i++)
+        h[i] = (uint16_t)i;
+    kern->widen_f16(got, h, 65536);
+    for (uint32_t i = 0; i < 65536; i++)
+    {
+        const float want = f16_to_f32(h[i]);
+        assert(memcmp(&got[i], &want, sizeof(float)) == 0);
+    }
+    assert(f16_to_f32(0x3c00) == 1.0f && f16_to_f32(0xc000) == -2.0f && f16_to_f32(0x0001) == 0x1p-24f);
+}
+
+// The FP16 microkernel must match the FP32 one on the widened panel exactly: only the load differs
+void test_gemm_ukernel_f16(const kernels_t *kern)
+{
+    enum { KC = 37 };
+    const size_t mr = kern->gemm_mr;
+    _Alignas(64) static uint16_t b16[KC * GEMM_NR];
+    _Alignas(64) static float b32[KC * GEMM_NR], a[KC * GEMM_MR_MAX];
+    float c32[GEMM_MR_MAX * GEMM_NR], c16[GEMM_MR_MAX * GEMM_NR];
+    for (size_t i = 0; i < KC * GEMM_NR; i++)
+        b16[i] = (uint16_t)(0x3000 + (i * 7919) % 0x1000) | (i % 3 ? 0 : 0x8000); // about +-[0.125, 0.5)
+    kern->widen_f16(b32, b16, KC * GEMM_NR);
+    for (size_t i = 0; i < KC * mr; i++)
+        a[i] = sinf((float)i);
+
+    for (int accumulate = 0; accumulate < 2; accumulate++)
+    {
+        for (size_t i = 0; i < mr * GEMM_NR; i++)
+            c32[i] = c16[i] = (float)i;
+        kern->gemm_ukernel(KC, a, b32, c32, GEMM_NR, accumulate);
+        kern->gemm_ukernel_f16(KC, a, b16, c16, GEMM_NR, accumulate);
+        assert(memcmp(c32, c16, mr * GEMM_NR * sizeof(float)) == 0);
+    }
+}
+
+// Skinny kernel against a double-precision reference, every row count, with K past GEMM_KC
+// so that the row-group path of the narrower ISAs is covered too
+void test_gemm_skinny(const kernels_t *kern)
+{
+    enum { K = 300, LDA = 311, LDC = 21 };
+    _Alignas(64) static uint16_t b16[K * GEMM_NR];
+    _Alignas(64) static float b32[K * GEMM_NR];
+    static float a[GEMM_SKINNY_MAX * LDA], c32[GEMM_SKINNY_MAX * LDC], c16[GEMM_SKINNY_MAX * LDC];
+    for (size_t i = 0; i < K * GEMM_NR; i++)
+        b16[i] = (uint16_t)(0x3000 + (i * 7919) % 0x1000) | (i % 3 ? 0 : 0x8000);
+    kern->widen_f16(b32, b16, K * GEMM_NR);
+    for (size_t i = 0; i < GEMM_SKINNY_MAX * LDA; i++)
+        a[i] = sinf((float)i);
+
+    for (size_t m = 1; m <= GEMM_SKINNY_MAX; m++)
+    {
+        for (size_t k_len = 1; k_len <= K; k_len += K - 1)
+        {
+            kern->gemm_skinny_panel(m, k_len, a, LDA, b32, c32, LDC);
+            kern->gemm_skinny_panel_f16(m, k_len, a, LDA, b16, c16, LDC);
+            for (size_t i = 0; i < m; i++)
+                for (size_t j = 0; j < GEMM_NR; j++)
+                {
+                    double want = 0.0;
+                    for (size_t k = 0; k < k_len; k++)
+                        want += (double)a[i * LDA + k] * b32[k * GEMM_NR + j];
+                    assert(fabs(c32[i * LDC + j] - want) < 1e-4);
+                    assert(c16[i * LDC + j] == c32[i * LDC + j]);
+                }
+        }
+    }
+}
+
+// Transpose: full register blocks and ragged edges, with padded leading dimensions
+void test_transpose(const kernels_t *kern)
+{
+    enum { R = 53, C = 37, LDS = 61, LDD = 59 };
+    static float src[R * LDS], dst[C * LDD];
+    for (size_t i = 0; i < R * LDS; i++)
+        src[i] = (float)i;
+    for (size_t i = 0; i < C * LDD; i++)
+        dst[i] = -1.0f;
+    kern->transpose(dst, LDD, src, LDS, R, C);
+    for (size_t j = 0; j < C; j++)
+        for (size_t i = 0; i < LDD; i++)
+            assert(dst[j * LDD + i] == (i < R ? src[i * LDS + j] : -1.0f));
+}
+
+// Layer norm against double precision, at the model's hidden size (the generated kernel when
+// the build has one), at another size and in place
+void test_layer_norm(const kernels_t *kern)
+{
+    static const size_t sizes[] = {384, 100};
+    float x[384], out[384], gamma[384], beta[384];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        const size_t n = sizes[s];
+        double mean = 0.0, var = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            x[i] = 100.0f + 3.0f * sinf((float)i * 0.7f); // |mean| >> std
+            gamma[i] = 1.0f + 0.01f * (float)(i % 7);
+            beta[i] = 0.1f * cosf((float)i);
+            mean += x[i];
+        }
+        mean /= (double)n;
+        for (size_t i = 0; i < n; i++)
+            var += ((double)x[i] - mean) * ((double)x[i] - mean);
+        var /= (double)n;
+
+        kern->layer_norm_row(out, x, gamma, beta, n, 1e-12f);
+        kern->layer_norm_row(x, x, gamma, beta, n, 1e-12f);
+        for (size_t i = 0; i < n; i++)
+        {
+            const double want = (100.0 + 3.0 * sin((double)(float)((float)i * 0.7f)) - mean) / sqrt(var) * gamma[i] + beta[i];
+            assert(fabs(out[i] - want) < 1e-4);
+            assert(x[i] == out[i]);
+        }
+    }
+}
+
+// Attention against a double-precision softmax, for the model's head size (the generated
+// kernel when the build has one) and another one, with ragged and over-long key counts
+void test_attention(const kernels_t *kern)
+{
+    enum { NQ = 5, LD = 70, MAX_KV = 200 };
+    static const size_t heads[] = {32, 24};
+    static const size_t kvs[] = {1, 7, 64, 128, 200};
+    static float q[NQ * LD], k[MAX_KV * LD], v[MAX_KV * LD], mask[MAX_KV], o[NQ * LD];
+    for (size_t i = 0; i < NQ * LD; i++)
+        q[i] = sinf((float)i * 0.37f);
+    for (size_t i = 0; i < MAX_KV * LD; i++)
+    {
+        k[i] = cosf((float)i * 0.11f);
+        v[i] = sinf((float)i * 0.23f);
+    }
+    for (size_t j = 0; j < MAX_KV; j++)
+        mask[j] = j % 5 == 3 ? 0.0f : 1.0f;
+
+    for (size_t h = 0; h < sizeof(heads) / sizeof(heads[0]); h++)
+        for (size_t t = 0; t < sizeof(kvs) / sizeof(kvs[0]); t++)
+            for (int masked = 0; masked < 2; masked++)
+            {
+                const size_t d = heads[h], n_kv = kvs[t];
+                const float scale = 1.0f / sqrtf((float)d);
+                kern->attention(q, LD, NQ, k, v, LD, n_kv, masked ? mask : NULL, scale, o, LD, d);
+                for (size_t i = 0; i < NQ; i++)
+                {
+                    double p[MAX_KV], mx = -1e300, sum = 0.0;
+                    for (size_t j = 0; j < n_kv; j++)
+                    {
+                        p[j] = 0.0;
+                        for (size_t c = 0; c < d; c++)
+                            p[j] += (double)q[i * LD + c] * k[j * LD + c];
+                        p[j] = masked && mask[j] == 0.0f ? -1e300 : p[j] * scale;
+                        mx = fmax(mx, p[j]);
+                    }
+                    for (size_t j = 0; j < n_kv; j++)
+                        sum += p[j] = exp(p[j] - mx);
+                    for (size_t c = 0; c < d; c++)
+                    {
+                        double want = 0.0;
+                        for (size_t j = 0; j < n_kv; j++)
+                            want += p[j] / sum * v[j * LD + c];
+                        assert(fabs(o[i * LD + c] - want) < 1e-5);
+                    }
+                }
+            }
+}
+
+// The int8 microkernel sums exactly: every variant must match the scalar int32 product,
+// including the extreme values where vpmaddubsw could saturate
+void test_gemm_ukernel_i8(const kernels_t *kern)
+{
+    enum { KQ = 97 };
+    const size_t mr = kern->gemm_mr;
+    _Alignas(64) static int8_t a[KQ * GEMM_MR_MAX * 4], b[KQ * GEMM_NR * 4];
+    _Alignas(64) static int32_t b_sum[GEMM_NR], c[GEMM_MR_MAX * GEMM_NR];
+    for (size_t i = 0; i < sizeof(a); i++)
+        a[i] = (int8_t)(i % 5 == 0 ? -127 : (int)((i * 7919) % 255) - 127);
+    for (size_t i = 0; i < sizeof(b); i++)
+        b[i] = (int8_t)(i % 7 == 0 ? 127 : (int)((i * 104729) % 255) - 127);
+    memset(b_sum, 0, sizeof(b_sum));
+    for (size_t k = 0; k < KQ; k++)
+        for (size_t j = 0; j < GEMM_NR; j++)
+            for (size_t q = 0; q < 4; q++)
+                b_sum[j] += b[(k * GEMM_NR + j) * 4 + q];
+
+    kern->gemm_ukernel_i8(KQ, a, b, b_sum, c);
+    for (size_t i = 0; i < mr; i++)
+        for (size_t j = 0; j < GEMM_NR; j++)
+        {
+            int32_t want = 0;
+            for (size_t k = 0; k < KQ; k++)
+                for (size_t q = 0; q < 4; q++)
+                    want += a[(k * mr + i) * 4 + q] * b[(k * GEMM_NR + j) * 4 + q];
+            assert(c[i * GEMM_NR + j] == want);
+        }
+}
+
+int main(void)
+{
+    const kernels_t *tables[8];
+    const size_t n = kernels_supported(tables, 8);
+    for (size_t i = 0; i < n; i++)
+    {
+        test_vector_math(tables[i]);
+        test_softmax(tables[i]);
+        test_widen_f16(tables[i]);
+        test_gemm_ukernel_f16(tables[i]);
+        test_gemm_ukernel_i8(tables[i]);
+        test_gemm_skinny(tables[i]);
+        test_transpose(tables[i]);
+        test_layer_norm(tables[i]);
+        test_attention(tables[i]);
+    }
+    printf("kernels: %zu variant(s) ok\n", n);
+    return 0;
+}
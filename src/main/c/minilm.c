@@ -5,15 +5,33 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <math.h>
+#include <pthread.h>
+#include "arena.h"
 #include "tbf.h"
 #include "nn.h"
+#include "kernels.h"
+#include "autotune.h"
 #include "s8.h"
 #include "tokenizer.h"
 
+// Weight at its stored precision, for packing or the embedding gather: float32 or float16,
+// int8 too where `int8_ok` (the word embedding table, which carries per-row scales)
+void init_mat(TbfFile tf, const char *name, tensor_t *out, bool int8_ok)
+{
+    tensor_t *t = tbf_get_tensor(tf, name);
+    if (!t || (t->dtype != 1 && t->dtype != 2 && !(int8_ok && t->dtype == 7)))
+    {
+        fprintf(stderr, "Failed to get tensor from TBF file\n");
+        exit(1);
+    }
+    *out = *t;
+}
+
+// Weight read by the float kernels directly; float16 ones are widened once here
 void init_mat_f32(TbfFile tf, const char *name, tensor_t *out)
 {
     tensor_t *t = tbf_get_tensor(tf, name);
-    if (!t)
+    if (!t || tbf_tensor_to_f32(tf, t) != T_OK)
     {
         fprintf(stderr, "Failed to get tensor from TBF file\n");
         exit(1);
@@ -21,46 +39,107 @@ void init_mat_f32(TbfFile tf, const char *name, tensor_t *out)
     *out = *t;
 }
 
+// Packs a linear weight for the GEMM, or quantizes it to int8
+static t_status pack_linear(tensor_packed_t *packed, const tensor_t w, bool int8)
+{
+    return int8 ? tensor_quantize_linear(packed, w) : tensor_pack_linear(packed, w);
+}
+
+void init_linear(TbfFile tf, const char *name, tensor_t *out, tensor_packed_t *packed, bool int8)
+{
+    init_mat(tf, name, out, false);
+    if (pack_linear(packed, *out, int8) != T_OK)
+    {
+        fprintf(stderr, "Failed to pack linear weight %s\n", name);
+        exit(1);
+    }
+}
+
+// Concatenates the query, key and value projections of a layer into one linear layer,
+// keeping their stored precision
+void init_qkv(bert_layer_weigts_t *attn, bool int8)
+{
+    const tensor_t parts[3] = {attn->query, attn->key, attn->value};
+    const tensor_t biases[3] = {attn->query_bias, attn->key_bias, attn->value_bias};
+    const uint32_t n = attn->query.dims[0], hidden = attn->query.dims[1];
+    const uint8_t dtype = attn->query.dtype;
+    const size_t elem = dtype == 2 ? sizeof(uint16_t) : sizeof(float);
+
+    tensor_t w = tensor_create(2, (uint32_t[]){3 * n, hidden}); // float-sized, large enough for halves
+    w.dtype = dtype;
+    attn->qkv_bias = tensor_create(1, (uint32_t[]){3 * n});
+    for (size_t i = 0; i < 3; i++)
+    {
+        if (parts[i].dims[0] != n || parts[i].dims[1] != hidden || parts[i].dtype != dtype ||
+            tensor_numel(biases[i]) != n)
+        {
+            fprintf(stderr, "Query, key and value shapes differ\n");
+            exit(1);
+        }
+        memcpy((uint8_t *)w.data + i * n * hidden * elem, parts[i].data, (size_t)n * hidden * elem);
+        memcpy(attn->qkv_bias.data + i * n, biases[i].data, n * sizeof(float));
+    }
+    if (pack_linear(&attn->qkv_packed, w, int8) != T_OK)
+    {
+        fprintf(stderr, "Failed to pack fused query/key/value weight\n");
+        exit(1);
+    }
+    tensor_destroy(&w);
+}
+
 t_status minilm_tokenize(minilm_t m, s8 str, da_u32 *ids)
 {
-    m_try(tokenizer_encode(m.tokenizer, (uint8_t *)str.data, str.len, ids));
+    if (tokenizer_encode(m.tokenizer, (uint8_t *)str.data, str.len, ids) != 0)
+        return T_ERR;
 
-    // pad up to 128
-    for (size_t i = ids->len; i < 128; i++)
+    // no padding: the encoder runs on the real token count
+    if (ids->len > MINILM_MAX_TOKENS)
     {
-        da_u32_append(ids, 0);
+        ids->data[MINILM_MAX_TOKENS - 1] = ids->data[ids->len - 1]; // keep [SEP]
+        ids->len = MINILM_MAX_TOKENS;
     }
-    
+
     return T_OK;
 }
 
-void minilm_weights_init(TbfFile tf, minilm_t *weights)
+void minilm_weights_init(TbfFile tf, minilm_t *weights, bool int8)
 {
-    init_mat_f32(tf, "embeddings.word_embeddings.weight", &weights->embeddings.word);
+    init_mat(tf, "embeddings.word_embeddings.weight", &weights->embeddings.word, true);
+    if (weights->embeddings.word.dtype == 7)
+    {
+        init_mat_f32(tf, "embeddings.word_embeddings.weight_scale", &weights->embeddings.word_scale);
+        if (tensor_numel(weights->embeddings.word_scale) != weights->embeddings.word.dims[0])
+        {
+            fprintf(stderr, "Word embedding scales do not match the table\n");
+            exit(1);
+        }
+    }
     init_mat_f32(tf, "embeddings.token_type_embeddings.weight", &weights->embeddings.type);
     init_mat_f32(tf, "embeddings.position_embeddings.weight", &weights->embeddings.pos);
     init_mat_f32(tf, "embeddings.LayerNorm.weight", &weights->embeddings.ln_gamma);
     init_mat_f32(tf, "embeddings.LayerNorm.bias", &weights->embeddings.ln_beta);
 
     // encoder layer
-    for (size_t i = 0; i < 6; i++)
+    for (size_t i = 0; i < MINILM_N_LAYERS; i++)
     {
         bert_layer_weigts_t *attn = &weights->attention[i];
         char name[100];
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.self.query.weight", i);
-        init_mat_f32(tf, name, &attn->query);
+        init_mat(tf, name, &attn->query, false);
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.self.query.bias", i);
         init_mat_f32(tf, name, &attn->query_bias);
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.self.key.weight", i);
-        init_mat_f32(tf, name, &attn->key);
+        init_mat(tf, name, &attn->key, false);
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.self.key.bias", i);
         init_mat_f32(tf, name, &attn->key_bias);
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.self.value.weight", i);
-        init_mat_f32(tf, name, &attn->value);
+        init_mat(tf, name, &attn->value, false);
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.self.value.bias", i);
         init_mat_f32(tf, name, &attn->value_bias);
+        init_qkv(attn, int8);
+        attn->n_heads = tf.meta.n_heads ? tf.meta.n_heads : MINILM_DEFAULT_HEADS;
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.output.dense.weight", i);
-        init_mat_f32(tf, name, &attn->output.weight);
+        init_linear(tf, name, &attn->output.weight, &attn->output.weight_packed, int8);
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.output.dense.bias", i);
         init_mat_f32(tf, name, &attn->output.bias);
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.output.LayerNorm.weight", i);
@@ -68,11 +147,11 @@ void minilm_weights_init(TbfFile tf, minilm_t *weights)
         snprintf(name, sizeof(name), "encoder.layer.%zu.attention.output.LayerNorm.bias", i);
         init_mat_f32(tf, name, &attn->output.ln_beta);
         snprintf(name, sizeof(name), "encoder.layer.%zu.intermediate.dense.weight", i);
-        init_mat_f32(tf, name, &attn->intermediate.weight);
+        init_linear(tf, name, &attn->intermediate.weight, &attn->intermediate.weight_packed, int8);
         snprintf(name, sizeof(name), "encoder.layer.%zu.intermediate.dense.bias", i);
         init_mat_f32(tf, name, &attn->intermediate.bias);
         snprintf(name, sizeof(name), "encoder.layer.%zu.output.dense.weight", i);
-        init_mat_f32(tf, name, &attn->output_2.weight);
+        init_linear(tf, name, &attn->output_2.weight, &attn->output_2.weight_packed, int8);
         snprintf(name, sizeof(name), "encoder.layer.%zu.output.dense.bias", i);
         init_mat_f32(tf, name, &attn->output_2.bias);
         snprintf(name, sizeof(name), "encoder.layer.%zu.output.LayerNorm.weight", i);
@@ -82,109 +161,377 @@ void minilm_weights_init(TbfFile tf, minilm_t *weights)
     }
 }
 
-tensor_t minilm_embedder_forward(da_u32 ids, minilm_t weights)
+t_status minilm_embedder_forward(tensor_t *out, da_u32 ids, nn_seqs_t seqs, minilm_t weights)
 {
-    tensor_t word_out, pos_out, type_out;
-    uint32_t num_tokens = ids.len;
-    nn_embeddings_forward(&word_out, ids.data, num_tokens, weights.embeddings.word);
+    const uint32_t num_tokens = ids.len;
+    const tensor_t word = weights.embeddings.word, pos = weights.embeddings.pos, type = weights.embeddings.type;
+    const size_t hidden = word.dims[1];
+    m_try(tensor_ensure(out, 2, (uint32_t[]){num_tokens, hidden}));
 
-    tensor_t position_ids = tensor_create(1, (uint32_t[]){num_tokens});
-    for (size_t i = 0; i < num_tokens; i++)
+    // word + position + token type (always 0) gathered and summed in one pass;
+    // positions restart at 0 for every sequence
+    const float *type0 = type.data;
+    const uint16_t *word_f16 = word.dtype == 2 ? (const uint16_t *)word.data : NULL;
+    const int8_t *word_i8 = word.dtype == 7 ? (const int8_t *)word.data : NULL;
+    const kernels_t *kern = kernels_get();
+    for (size_t b = 0; b < seqs.n; b++)
     {
-        ((int *)position_ids.data)[i] = i;
+        for (size_t t = seqs.offsets[b]; t < seqs.offsets[b + 1]; t++)
+        {
+            float *dst = out->data + t * out->strides[0];
+            const float *p = pos.data + (t - seqs.offsets[b]) * pos.strides[0];
+            if (word_i8)
+            {
+                // int8 table with one scale per row: dequantized in the same pass
+                const size_t id = ids.data[t];
+                const int8_t *w = word_i8 + id * word.strides[0];
+                const float scale = weights.embeddings.word_scale.data[id];
+                TENSOR_MAP(j, hidden, dst[j] = scale * (float)w[j] + p[j] + type0[j]);
+                continue;
+            }
+            if (word_f16)
+            {
+                // the table stays FP16 (half the size); only the gathered rows are widened
+                kern->widen_f16(dst, word_f16 + (size_t)ids.data[t] * word.strides[0], hidden);
+                TENSOR_MAP(j, hidden, dst[j] += p[j] + type0[j]);
+                continue;
+            }
+            const float *w = word.data + (size_t)ids.data[t] * word.strides[0];
+            TENSOR_MAP(j, hidden, dst[j] = w[j] + p[j] + type0[j]);
+        }
     }
-    nn_embeddings_forward(&pos_out, (uint32_t *)position_ids.data, num_tokens, weights.embeddings.pos);
 
-    uint32_t *token_type_ids = (uint32_t *)calloc(num_tokens, sizeof(uint32_t));
-    nn_embeddings_forward(&type_out, token_type_ids, num_tokens, weights.embeddings.type);
+    return nn_layer_norm_inplace(*out, weights.embeddings.ln_gamma, weights.embeddings.ln_beta, weights.pool);
+}
 
-    tensor_binary_op(word_out, pos_out, B_ADD);
-    tensor_binary_op(word_out, type_out, B_ADD);
+t_status minilm_output_forward(tensor_t *out, const tensor_t hidden_states, const tensor_t input_tensor, struct output_layer_t params,
+                               arena_t *scratch, pool_t *pool)
+{
+    m_try(nn_linear_fused_forward(out, hidden_states, params.weight_packed, params.bias, NN_ACT_NONE, &input_tensor, scratch,
+                                  pool));
+    m_try(nn_layer_norm_inplace(*out, params.ln_gamma, params.ln_beta, pool));
+    return T_OK;
+}
 
-    // layer norm
-    tensor_t ln_gamma = weights.embeddings.ln_gamma;
-    tensor_t ln_beta = weights.embeddings.ln_beta;
-    int res = nn_layer_norm_forward(&pos_out, word_out, ln_gamma, ln_beta);
-    if (res)
-    {
-        fprintf(stderr, "Failed to layer norm\n");
-    }
+t_status minilm_encoder_forward(const tensor_t in, nn_seqs_t seqs, bert_layer_weigts_t weights, tensor_t *out, arena_t *scratch, pool_t *pool)
+{
+    const uint32_t n_tokens = in.dims[0], hidden = in.dims[1];
+    const size_t mark = arena_mark(scratch);
+    tensor_t attn_out; // attention block output, input of the feed-forward block
+    m_try(arena_tensor(scratch, &attn_out, 2, (uint32_t[]){n_tokens, hidden}));
+
+    // qkv and the attention context are dead once attn_out is written;
+    // the intermediate activation reuses their space
+    const size_t attn_mark = arena_mark(scratch);
+    tensor_t qkv, self_out;
+    m_try(arena_tensor(scratch, &qkv, 2, (uint32_t[]){n_tokens, weights.qkv_packed.N}));
+    m_try(arena_tensor(scratch, &self_out, 2, (uint32_t[]){n_tokens, hidden}));
+
+    // one GEMM for all three projections; attention reads q, k and v as column views
+    m_try(nn_linear_forward(&qkv, in, weights.qkv_packed, weights.qkv_bias, scratch, pool)); // [S, 3 * HIDDEN_SIZE]
+    tensor_t q = tensor_view(2, (uint32_t[]){n_tokens, hidden}, qkv.data);
+    tensor_t k = tensor_view(2, (uint32_t[]){n_tokens, hidden}, qkv.data + hidden);
+    tensor_t v = tensor_view(2, (uint32_t[]){n_tokens, hidden}, qkv.data + 2 * hidden);
+    q.strides[0] = k.strides[0] = v.strides[0] = qkv.strides[0];
+
+    m_try(nn_dot_product_attention_forward(&self_out, q, k, v, seqs, weights.n_heads, scratch, pool));
+    m_try(minilm_output_forward(&attn_out, self_out, in, weights.output, scratch, pool));
+    arena_rewind(scratch, attn_mark);
+
+    // intermediate
+    tensor_t intermediate;
+    m_try(arena_tensor(scratch, &intermediate, 2, (uint32_t[]){n_tokens, weights.intermediate.weight_packed.N}));
+    m_try(nn_linear_fused_forward(&intermediate, attn_out, weights.intermediate.weight_packed, weights.intermediate.bias,
+                                  NN_ACT_GELU, NULL, scratch, pool));
+
+    // output
+    m_try(minilm_output_forward(out, intermediate, attn_out, weights.output_2, scratch, pool));
+
+    arena_rewind(scratch, mark);
+    return T_OK;
+}
 
-    tensor_destroy(&word_out);
-    tensor_destroy(&type_out);
-    tensor_destroy(&position_ids);
+// Activation workspaces. A call takes one off the free list, or creates one when all are
+// in use (once per level of concurrency), grows it to fit its batch if needed and puts it
+// back, so steady-state inference does not go through malloc for activations.
+typedef struct minilm_workspace_t
+{
+    arena_t arena;
+    struct minilm_workspace_t *next;
+} minilm_workspace_t;
+
+struct minilm_workspaces_t
+{
+    pthread_mutex_t lock;
+    minilm_workspace_t *free;
+};
 
-    return pos_out;
+// Arena bytes minilm_encode_seqs needs for a batch of `n_tokens` tokens
+static size_t minilm_workspace_bytes(const minilm_t *m, size_t n_tokens)
+{
+    const size_t row = n_tokens * sizeof(float);
+    const size_t hidden = m->embeddings.word.dims[1];
+    const bert_layer_weigts_t *layer = &m->attention[0];
+
+    // per layer: attn_out, then qkv + self_out, later replaced by the intermediate activation
+    size_t scratch = arena_footprint(row * layer->qkv_packed.N) + arena_footprint(row * hidden);
+    if (arena_footprint(row * layer->intermediate.weight_packed.N) > scratch)
+        scratch = arena_footprint(row * layer->intermediate.weight_packed.N);
+    // above those, one at a time: the GEMM packing buffers or the attention task list
+    size_t transient = arena_footprint(gemm_scratch_size(pool_size(m->pool)));
+    if (nn_attention_scratch_bytes(n_tokens) > transient)
+        transient = nn_attention_scratch_bytes(n_tokens);
+    return 2 * arena_footprint(row * hidden) // layer input and output, swapped every layer
+           + arena_footprint(row * hidden)   // attn_out
+           + scratch + transient;
 }
 
-t_status minilm_output_forward(tensor_t *out, const tensor_t hidden_states, const tensor_t input_tensor, struct output_layer_t params)
+static t_status minilm_workspaces_create(minilm_t *m)
 {
-    nn_linear_forward(out, hidden_states, params.weight, params.bias);
-    tensor_binary_op(*out, input_tensor, B_ADD);
-    nn_layer_norm_forward(out, *out, params.ln_gamma, params.ln_beta);
+    m->workspaces = (struct minilm_workspaces_t *)calloc(1, sizeof(struct minilm_workspaces_t));
+    if (!m->workspaces)
+        return T_ERR;
+    pthread_mutex_init(&m->workspaces->lock, NULL);
+
+    // one workspace up front, sized for a single full-length sequence
+    minilm_workspace_t *w = (minilm_workspace_t *)calloc(1, sizeof(minilm_workspace_t));
+    if (!w || arena_init(&w->arena, minilm_workspace_bytes(m, MINILM_MAX_TOKENS)) != T_OK)
+    {
+        free(w);
+        pthread_mutex_destroy(&m->workspaces->lock);
+        free(m->workspaces);
+        m->workspaces = NULL; // non-NULL only for a fully created session
+        return T_ERR;
+    }
+    m->workspaces->free = w;
     return T_OK;
 }
 
-t_status minilm_encoder_forward(const tensor_t in, bert_layer_weigts_t weights, tensor_t *out)
+static void minilm_workspaces_destroy(minilm_t *m)
 {
-    tensor_t q, k, v;
-    tensor_t self_out;
+    if (!m->workspaces)
+        return;
+    for (minilm_workspace_t *w = m->workspaces->free, *next; w; w = next)
+    {
+        next = w->next;
+        arena_destroy(&w->arena);
+        free(w);
+    }
+    pthread_mutex_destroy(&m->workspaces->lock);
+    free(m->workspaces);
+    m->workspaces = NULL;
+}
+
+// A reset workspace large enough for `n_tokens` tokens, NULL when out of memory
+static minilm_workspace_t *minilm_workspace_acquire(const minilm_t *m, size_t n_tokens)
+{
+    struct minilm_workspaces_t *ws = m->workspaces;
+    pthread_mutex_lock(&ws->lock);
+    minilm_workspace_t *w = ws->free;
+    if (w)
+        ws->free = w->next;
+    pthread_mutex_unlock(&ws->lock);
+
+    if (!w && !(w = (minilm_workspace_t *)calloc(1, sizeof(minilm_workspace_t))))
+        return NULL;
+    const size_t need = minilm_workspace_bytes(m, n_tokens);
+    if (w->arena.cap < need)
+    {
+        // grow geometrically so batches of slowly increasing size do not reallocate every time
+        const size_t cap = need > w->arena.cap + w->arena.cap / 2 ? need : w->arena.cap + w->arena.cap / 2;
+        arena_destroy(&w->arena);
+        if (arena_init(&w->arena, cap) != T_OK)
+        {
+            free(w);
+            return NULL;
+        }
+    }
+    arena_reset(&w->arena);
+    return w;
+}
 
-    nn_linear_forward(&q, in, weights.query, weights.query_bias);
-    nn_linear_forward(&k, in, weights.key, weights.key_bias);
-    nn_linear_forward(&v, in, weights.value, weights.value_bias);
+static void minilm_workspace_release(const minilm_t *m, minilm_workspace_t *w)
+{
+    struct minilm_workspaces_t *ws = m->workspaces;
+    pthread_mutex_lock(&ws->lock);
+    w->next = ws->free;
+    ws->free = w;
+    pthread_mutex_unlock(&ws->lock);
+}
 
-    m_try(nn_dot_product_attention_forward(&self_out, q, k, v, 12));
+// Runs the encoder on every sequence of `seqs` and writes one normalized
+// embedding per sequence, [seqs.n, HIDDEN_SIZE], to out. Activations come from `arena`.
+static t_status minilm_encode_seqs(minilm_t weights, da_u32 ids, nn_seqs_t seqs, arena_t *arena, float *out)
+{
+    const uint32_t n_tokens = ids.len, hidden = weights.embeddings.word.dims[1];
+    tensor_t states[2];
+    m_try(arena_tensor(arena, &states[0], 2, (uint32_t[]){n_tokens, hidden}));
+    m_try(arena_tensor(arena, &states[1], 2, (uint32_t[]){n_tokens, hidden}));
 
-    tensor_t tmp;
-    minilm_output_forward(&tmp, self_out, in, weights.output);
+    m_try(minilm_embedder_forward(&states[0], ids, seqs, weights));
+    for (size_t i = 0; i < MINILM_N_LAYERS; i++)
+        m_try(minilm_encoder_forward(states[i % 2], seqs, weights.attention[i], &states[(i + 1) % 2], arena, weights.pool));
+    const tensor_t last = states[MINILM_N_LAYERS % 2];
 
-    // intermediate
-    tensor_t intermediate_buffer;
-    nn_linear_forward(&intermediate_buffer, tmp, weights.intermediate.weight, weights.intermediate.bias);
-    tensor_unary_op(intermediate_buffer, U_GELU, NULL);
+    for (size_t b = 0; b < seqs.n; b++)
+    {
+        const uint32_t row0 = seqs.offsets[b], len = seqs.offsets[b + 1] - row0;
+        tensor_t seq = tensor_view(2, (uint32_t[]){len, hidden}, last.data + (size_t)row0 * hidden);
+        tensor_t mask = seqs.mask ? tensor_view(1, (uint32_t[]){len}, (float *)seqs.mask + row0) : (tensor_t){0};
 
-    // output
-    minilm_output_forward(out, intermediate_buffer, tmp, weights.output_2);
-
-    tensor_destroy(&q);
-    tensor_destroy(&k);
-    tensor_destroy(&v);
-    tensor_destroy(&self_out);
-    tensor_destroy(&intermediate_buffer);
-    tensor_destroy(&tmp);
+        tensor_t pooled_out = tensor_view(2, (uint32_t[]){1, hidden}, out + b * hidden);
+        m_try(nn_mean_pooling(&pooled_out, seq, mask));
+        nn_normalize(&pooled_out);
+    }
     return T_OK;
 }
 
 t_status minilm_encode(minilm_t weights, da_u32 ids, tensor_t *out)
 {
-    tensor_t embedder_out = minilm_embedder_forward(ids, weights);
-    tensor_t tmp;
-    for (size_t i = 0; i < 6; i++)
-    {
-        m_try(minilm_encoder_forward(embedder_out, weights.attention[i], &tmp));
-        embedder_out = tmp;
-    }
-    tensor_t pooled_out;
-    nn_mean_pooling(&pooled_out, embedder_out, embedder_out);
-    nn_normalize(&pooled_out);
+    if (ids.len == 0 || ids.len > weights.embeddings.pos.dims[0])
+        return T_ERR;
+    minilm_workspace_t *ws = minilm_workspace_acquire(&weights, ids.len);
+    if (!ws)
+        return T_ERR;
 
-    tensor_destroy(&embedder_out);
+    // no padding: every id is a real token (unknown words are id 0 too), as in the packed path
+    const uint32_t offsets[2] = {0, ids.len};
+    nn_seqs_t seqs = {.n = 1, .offsets = offsets, .mask = NULL};
 
-    *out = pooled_out;
-    return 0;
+    *out = tensor_create(2, (uint32_t[]){1, weights.embeddings.word.dims[1]});
+    t_status res = minilm_encode_seqs(weights, ids, seqs, &ws->arena, out->data);
+    minilm_workspace_release(&weights, ws);
+    if (res != T_OK)
+        tensor_destroy(out);
+    return res;
 }
 
 int minilm_create(minilm_t *m, const char *tbf_path, const char *vocab_txt_path)
 {
-    m_try(tbf_open(&m->tf, tbf_path));
-    minilm_weights_init(m->tf, m);
-    m_try(tokenizer_create(&m->tokenizer, vocab_txt_path));
+    return minilm_create_with_options(m, tbf_path, vocab_txt_path, (minilm_options_t){.n_threads = 1});
+}
+
+int minilm_autotune(const minilm_t *m, const char *cache_dir, bool force)
+{
+    // the four GEMMs of an encoder layer; every layer has the same shapes
+    const bert_layer_weigts_t *layer = &m->attention[0];
+    const tensor_packed_t *linear[] = {&layer->qkv_packed, &layer->output.weight_packed,
+                                       &layer->intermediate.weight_packed, &layer->output_2.weight_packed};
+    autotune_shape_t shapes[4];
+    for (size_t i = 0; i < 4; i++)
+        shapes[i] = (autotune_shape_t){.K = linear[i]->K, .N = linear[i]->N};
+    const autotune_weights_t weights = layer->qkv_packed.data_i8    ? AUTOTUNE_I8
+                                       : layer->qkv_packed.data_f16 ? AUTOTUNE_F16
+                                                                    : AUTOTUNE_F32;
+
+    autotune_result_t res;
+    if (!autotune_gemm(shapes, 4, MINILM_MAX_TOKENS, weights, cache_dir, force, &res))
+        return 1;
+    if (!res.cached)
+        fprintf(stderr, "[minilm] autotune: %s, GEMM blocks %zu x %zu\n", res.isa, res.tiling.mc, res.tiling.kc);
+    return 0;
+}
+
+// Sessions fully created and not yet destroyed, and whether autotuning has applied a choice
+static pthread_mutex_t session_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t n_sessions = 0;
+static bool tuned = false;
+
+// Hyperparameters of the weight file the encoder can run with; mismatches are reported on stderr
+static bool minilm_check_shapes(TbfFile tf)
+{
+    if (tf.meta.n_layers && tf.meta.n_layers != MINILM_N_LAYERS)
+    {
+        fprintf(stderr, "Weight file has %u layers, expected %d\n", tf.meta.n_layers, MINILM_N_LAYERS);
+        return false;
+    }
+    const tensor_t *word = tbf_get_tensor(tf, "embeddings.word_embeddings.weight");
+    const uint32_t hidden = word && word->ndim == 2 ? word->dims[1] : 0;
+    // embedding outputs, the batch scatter and the JNI buffers are MINILM_HIDDEN_SIZE wide
+    if (hidden != MINILM_HIDDEN_SIZE)
+    {
+        fprintf(stderr, "Weight file has hidden size %u, expected %d\n", hidden, MINILM_HIDDEN_SIZE);
+        return false;
+    }
+    const uint32_t n_heads = tf.meta.n_heads ? tf.meta.n_heads : MINILM_DEFAULT_HEADS;
+    if (n_heads == 0 || hidden % n_heads != 0 || hidden / n_heads > KERNELS_ATTN_MAX_D)
+    {
+        fprintf(stderr, "Weight file has %u attention heads for hidden size %u\n", n_heads, hidden);
+        return false;
+    }
+    return true;
+}
+
+int minilm_create_with_options(minilm_t *m, const char *tbf_path, const char *vocab_txt_path, minilm_options_t opts)
+{
+    // pick the kernel variant for this CPU before anything runs
+    kernels_init();
+    *m = (minilm_t){0}; // what is not set up yet stays zeroed for minilm_destroy
+    if (tbf_open_with(&m->tf, tbf_path, opts.copy_weights ? TBF_LOAD_COPY : TBF_LOAD_MMAP) != T_OK)
+        return 1;
+    if (!minilm_check_shapes(m->tf) || (opts.verify_weights && tbf_verify(m->tf) != T_OK))
+        goto fail;
+    minilm_weights_init(m->tf, m, opts.int8_linear);
+
+    // tuned once per process, by the first session that asks for it while no other session
+    // is running: tuning switches the process-wide kernel variant and GEMM blocking
+    const char *tune_env = getenv("MINILM_AUTOTUNE");
+    if (opts.autotune || (tune_env && *tune_env && strcmp(tune_env, "0") != 0))
+    {
+        pthread_mutex_lock(&session_lock);
+        if (!tuned && n_sessions == 0)
+            tuned = minilm_autotune(m, opts.autotune_dir, false) == 0;
+        else if (!tuned)
+            fprintf(stderr, "[minilm] autotune skipped: %zu session(s) already running\n", n_sessions);
+        pthread_mutex_unlock(&session_lock);
+    }
+    if (tokenizer_create(&m->tokenizer, vocab_txt_path) != 0)
+        goto fail;
+    if (opts.n_threads != 1)
+    {
+        m->pool = pool_create(opts.n_threads);
+        if (!m->pool)
+        {
+            fprintf(stderr, "Failed to start thread pool\n");
+            goto fail;
+        }
+    }
+    // sized for the pool: the GEMM packs into one slice per thread
+    if (minilm_workspaces_create(m) != T_OK)
+    {
+        fprintf(stderr, "Failed to allocate activation workspace\n");
+        goto fail;
+    }
+    pthread_mutex_lock(&session_lock);
+    n_sessions++;
+    pthread_mutex_unlock(&session_lock);
     return 0;
+
+fail:
+    minilm_destroy(m);
+    *m = (minilm_t){0};
+    return 1;
 }
 
 void minilm_destroy(minilm_t *m)
 {
+    if (m->workspaces) // set last by create, so only fully created sessions were counted
+    {
+        pthread_mutex_lock(&session_lock);
+        n_sessions--;
+        pthread_mutex_unlock(&session_lock);
+    }
+    for (size_t i = 0; i < MINILM_N_LAYERS; i++)
+    {
+        bert_layer_weigts_t *attn = &m->attention[i];
+        tensor_packed_destroy(&attn->qkv_packed);
+        tensor_destroy(&attn->qkv_bias);
+        tensor_packed_destroy(&attn->output.weight_packed);
+        tensor_packed_destroy(&attn->intermediate.weight_packed);
+        tensor_packed_destroy(&attn->output_2.weight_packed);
+    }
+    minilm_workspaces_destroy(m);
+    pool_destroy(m->pool);
     tbf_close(m->tf);
     tokenizer_destroy(&m->tokenizer);
 }
@@ -193,9 +540,161 @@ t_status minilm_embed(minilm_t m, char *str, size_t str_len, tensor_t *out)
 {
     s8 str_s8 = s8_from_parts(str, str_len);
     da_u32 ids = {0};
-    minilm_tokenize(m, str_s8, &ids);
-    
-    m_try(minilm_encode(m, ids, out));
+    t_status res = minilm_tokenize(m, str_s8, &ids);
+    if (res == T_OK)
+        res = minilm_encode(m, ids, out);
     da_u32_free(&ids);
-    return T_OK;
+    return res;
+}
+
+t_status minilm_encode_packed(minilm_t m, da_u32 ids, const uint32_t *cu_seqlens, size_t n, float *out)
+{
+    if (n == 0)
+        return T_OK;
+    if (cu_seqlens[0] != 0 || cu_seqlens[n] != ids.len)
+        return T_ERR;
+    for (size_t b = 0; b < n; b++)
+    {
+        const uint32_t len = cu_seqlens[b + 1] - cu_seqlens[b];
+        if (cu_seqlens[b + 1] < cu_seqlens[b] || len == 0 || len > m.embeddings.pos.dims[0])
+            return T_ERR;
+    }
+
+    minilm_workspace_t *ws = minilm_workspace_acquire(&m, ids.len);
+    if (!ws)
+        return T_ERR;
+    nn_seqs_t seqs = {.n = n, .offsets = cu_seqlens, .mask = NULL};
+    t_status res = minilm_encode_seqs(m, ids, seqs, &ws->arena, out);
+    minilm_workspace_release(&m, ws);
+    return res;
+}
+
+t_status minilm_embed_batch(minilm_t *m, const char **texts, const size_t *lens, size_t n, float *out)
+{
+    if (n == 0)
+        return T_OK;
+
+    // tokenize into one packed stream, no padding between sequences
+    da_u32 ids = {0}, seq_ids = {0};
+    uint32_t *cu_seqlens = (uint32_t *)malloc((n + 1) * sizeof(uint32_t));
+    if (!cu_seqlens)
+        return T_ERR;
+    cu_seqlens[0] = 0;
+    t_status res = T_OK;
+    for (size_t b = 0; b < n && res == T_OK; b++)
+    {
+        da_u32_reset(&seq_ids);
+        res = minilm_tokenize(*m, s8_from_parts((char *)texts[b], lens[b]), &seq_ids);
+        if (res == T_OK)
+            da_u32_extend(&ids, seq_ids.data, seq_ids.len);
+        cu_seqlens[b + 1] = ids.len;
+    }
+
+    if (res == T_OK)
+        res = minilm_encode_packed(*m, ids, cu_seqlens, n, out);
+
+    da_u32_free(&seq_ids);
+    da_u32_free(&ids);
+    free(cu_seqlens);
+    return res;
+}
+
+// bucket of a token count: 0 for <= 8, then one per power of two up to MINILM_MAX_TOKENS
+static uint32_t minilm_length_bucket(uint32_t len)
+{
+    uint32_t bucket = 0;
+    for (uint32_t cap = 8; cap < len; cap *= 2)
+        bucket++;
+    return bucket;
+}
+
+typedef struct
+{
+    uint32_t bucket;
+    uint32_t len;
+    size_t index;
+} minilm_bulk_item_t;
+
+static int minilm_bulk_item_cmp(const void *a, const void *b)
+{
+    const minilm_bulk_item_t *x = (const minilm_bulk_item_t *)a, *y = (const minilm_bulk_item_t *)b;
+    if (x->bucket != y->bucket)
+        return x->bucket < y->bucket ? -1 : 1;
+    if (x->len != y->len)
+        return x->len < y->len ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+t_status minilm_embed_bulk(minilm_t *m, const char **texts, const size_t *lens, size_t n, size_t token_budget, float *out)
+{
+    if (n == 0)
+        return T_OK;
+    if (token_budget == 0)
+        token_budget = MINILM_DEFAULT_TOKEN_BUDGET;
+    if (token_budget < MINILM_MAX_TOKENS)
+        token_budget = MINILM_MAX_TOKENS; // any single sequence must fit
+
+    // tokenize everything up front; text i owns all_ids[text_off[i], text_off[i + 1])
+    da_u32 all_ids = {0}, seq_ids = {0};
+    size_t *text_off = (size_t *)malloc((n + 1) * sizeof(size_t));
+    minilm_bulk_item_t *items = (minilm_bulk_item_t *)malloc(n * sizeof(minilm_bulk_item_t));
+    if (!text_off || !items)
+    {
+        free(items);
+        free(text_off);
+        return T_ERR;
+    }
+    text_off[0] = 0;
+    t_status res = T_OK;
+    for (size_t i = 0; i < n && res == T_OK; i++)
+    {
+        da_u32_reset(&seq_ids);
+        res = minilm_tokenize(*m, s8_from_parts((char *)texts[i], lens[i]), &seq_ids);
+        if (res == T_OK)
+            da_u32_extend(&all_ids, seq_ids.data, seq_ids.len);
+        text_off[i + 1] = all_ids.len;
+        items[i] = (minilm_bulk_item_t){.bucket = minilm_length_bucket(seq_ids.len), .len = seq_ids.len, .index = i};
+    }
+
+    // similar lengths end up in the same batch, which keeps attention tasks balanced
+    if (res == T_OK)
+        qsort(items, n, sizeof(minilm_bulk_item_t), minilm_bulk_item_cmp);
+
+    da_u32 batch_ids = {0};
+    uint32_t *cu_seqlens = (uint32_t *)malloc((n + 1) * sizeof(uint32_t));
+    float *batch_out = (float *)malloc(n * MINILM_HIDDEN_SIZE * sizeof(float));
+    if (!cu_seqlens || !batch_out)
+        res = T_ERR;
+    for (size_t first = 0; first < n && res == T_OK;)
+    {
+        // grow the batch within one bucket until the token budget is reached
+        da_u32_reset(&batch_ids);
+        cu_seqlens[0] = 0;
+        size_t count = 0;
+        while (first + count < n)
+        {
+            const minilm_bulk_item_t item = items[first + count];
+            if (count > 0 && (item.bucket != items[first].bucket || batch_ids.len + item.len > token_budget))
+                break;
+            da_u32_extend(&batch_ids, all_ids.data + text_off[item.index], item.len);
+            cu_seqlens[++count] = batch_ids.len;
+        }
+
+        res = minilm_encode_packed(*m, batch_ids, cu_seqlens, count, batch_out);
+
+        // scatter back into input order
+        for (size_t b = 0; b < count && res == T_OK; b++)
+            memcpy(out + items[first + b].index * MINILM_HIDDEN_SIZE, batch_out + b * MINILM_HIDDEN_SIZE,
+                   MINILM_HIDDEN_SIZE * sizeof(float));
+        first += count;
+    }
+
+    da_u32_free(&batch_ids);
+    da_u32_free(&seq_ids);
+    da_u32_free(&all_ids);
+    free(batch_out);
+    free(cu_seqlens);
+    free(items);
+    free(text_off);
+    return res;
 }
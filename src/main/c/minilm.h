@@ -2,19 +2,76 @@
 
 #include <stddef.h>
 #include "tensor.h"
+#include "nn.h"
 #include "tokenizer.h"
 #include "s8.h"
 #include "da.h"
+#include "pool.h"
+#include "arena.h"
 
 typedef struct minilm_t minilm_t;
 
+/// @brief Longest token sequence the model is run on, [CLS] and [SEP] included
+#define MINILM_MAX_TOKENS 128
+
+/// @brief Size of an embedding vector
+#define MINILM_HIDDEN_SIZE 384
+
+/// @brief Encoder layers of the model
+#define MINILM_N_LAYERS 6
+
+/// @brief Attention heads assumed when the weight file does not record them (TBF1)
+#define MINILM_DEFAULT_HEADS 12
+
+/// @brief Tokens per batch used by minilm_embed_bulk when no budget is given
+#define MINILM_DEFAULT_TOKEN_BUDGET 4096
+
+/// @brief Session options for minilm_create_with_options
+typedef struct minilm_options_t
+{
+  /// threads per inference call, including the caller: 0 = all online CPUs, 1 = single-threaded
+  uint32_t n_threads;
+  /// read the weights into private memory instead of mapping the .tbf file
+  /// (by default they are mmap-ed read-only and shared with other sessions and processes)
+  bool copy_weights;
+  /// check the per-tensor checksums of a TBF2 file at load time; this reads every weight page
+  bool verify_weights;
+  /// quantize the encoder's linear layers to int8 at load time (per output channel scales);
+  /// activations are quantized per row on every call. Faster on CPUs with AVX-512 VNNI,
+  /// at a cosine drift of about 2e-4 against the float32 embeddings (see minilm_test)
+  bool int8_linear;
+  /// on the first session of the process that sets it, apply the GEMM kernel variant and
+  /// blocking cached for this CPU model, or tune them now and cache them (minilm_autotune).
+  /// Both are process-wide, so this is skipped while another session exists; create the
+  /// tuning session first. The environment variable MINILM_AUTOTUNE=1 sets it for every session
+  bool autotune;
+  /// cache directory for `autotune`, NULL = $XDG_CACHE_HOME/minilm or ~/.cache/minilm
+  const char *autotune_dir;
+} minilm_options_t;
+
 /// @brief Load weights from tbf file and initialize the tokenizer using vocab.txt
+/// Single-threaded, same as minilm_create_with_options with n_threads = 1
 /// @param m minilm_t
 /// @param tbf_path path to tbf file
 /// @param vocab_txt_path path to vocab.txt
 /// @return 0 on success, 1 on error
 int minilm_create(minilm_t *m, const char *tbf_path, const char *vocab_txt_path);
 
+/// @brief minilm_create with explicit options; starts the session's worker pool
+/// @return 0 on success, 1 on error; on error everything set up so far is released and
+///         `m` is zeroed, there is nothing to destroy
+int minilm_create_with_options(minilm_t *m, const char *tbf_path, const char *vocab_txt_path, minilm_options_t opts);
+
+/// @brief Time the GEMM kernel variants and blocking sizes on the model's linear layer
+/// shapes and apply the fastest, or apply the choice cached for this CPU model (see
+/// autotune.h). The kernel variant and blocking are process-wide: this changes them for
+/// every session, including calls already running in other threads, which run on the trial
+/// variants while tuning. Call it before other sessions start inference.
+/// @param cache_dir NULL = $XDG_CACHE_HOME/minilm or ~/.cache/minilm
+/// @param force tune even if a cached choice exists, and replace it
+/// @return 0 on success, 1 on error
+int minilm_autotune(const minilm_t *m, const char *cache_dir, bool force);
+
 /// @brief Embed a string into a tensor of token ids
 /// Internally calls minilm_tokenize and minilm_encode
 /// @param m minilm_t
@@ -23,17 +80,43 @@ int minilm_create(minilm_t *m, const char *tbf_path, const char *vocab_txt_path)
 /// @return tensor of token ids
 t_status minilm_embed(minilm_t m, char *str, size_t str_len, tensor_t *out);
 
-/// @brief Destroy the minilm_t and free the memory
+/// @brief Embed a batch of strings in one pass through the encoder
+/// Token ids are packed back to back (see minilm_encode_packed), so every layer streams
+/// its weights once for the whole batch and only real tokens are computed.
+/// @param texts n strings, not necessarily NUL-terminated
+/// @param lens length in bytes of each string
+/// @param out n * MINILM_HIDDEN_SIZE floats, one normalized embedding per string
+t_status minilm_embed_batch(minilm_t *m, const char **texts, const size_t *lens, size_t n, float *out);
+
+/// @brief Embed a large set of strings with bounded memory
+/// Everything is tokenized first, then grouped by token count (buckets of <= 8, 16, 32, 64
+/// and 128 tokens) into packed batches of at most `token_budget` tokens, which are run
+/// through minilm_encode_packed. Results are written back in input order.
+/// @param token_budget max tokens per batch, 0 = MINILM_DEFAULT_TOKEN_BUDGET
+/// @param out n * MINILM_HIDDEN_SIZE floats
+t_status minilm_embed_bulk(minilm_t *m, const char **texts, const size_t *lens, size_t n, size_t token_budget, float *out);
+
+/// @brief Destroy the minilm_t and free the memory; parts that are still zeroed are skipped
 void minilm_destroy(minilm_t *m);
 
-/// @brief Encode a string into a tensor of token ids
+/// @brief Encode token ids into a normalized [1, HIDDEN_SIZE] embedding
+/// The encoder runs on all ids.len tokens, unmasked, exactly like one sequence of minilm_encode_packed.
 t_status minilm_encode(minilm_t m, da_u32 ids, tensor_t *out);
 
-/// @brief Tokenize a string into a tensor of token ids
+/// @brief Encode several sequences packed into one token stream, without padding
+/// Sequence b is ids[cu_seqlens[b], cu_seqlens[b + 1]). Linear layers, layer norm and GELU
+/// run on all real tokens at once; attention is block-diagonal, one block per sequence.
+/// @param cu_seqlens n + 1 cumulative offsets, cu_seqlens[0] == 0 and cu_seqlens[n] == ids.len
+/// @param out n * MINILM_HIDDEN_SIZE floats, one normalized embedding per sequence
+t_status minilm_encode_packed(minilm_t m, da_u32 ids, const uint32_t *cu_seqlens, size_t n, float *out);
+
+/// @brief Tokenize a string into token ids, without padding
+/// Sequences longer than MINILM_MAX_TOKENS are truncated, keeping the final [SEP].
 t_status minilm_tokenize(minilm_t m, s8 str, da_u32 *ids);
 
 /// @brief Embedder forward (embeddings + layer norm) - for testing
-tensor_t minilm_embedder_forward(da_u32 ids, minilm_t weights);
+/// Position ids restart at 0 at every sequence offset. `out` follows tensor_ensure.
+t_status minilm_embedder_forward(tensor_t *out, da_u32 ids, nn_seqs_t seqs, minilm_t weights);
 
 /// PyTorch reference:
 /// ```python
@@ -85,6 +168,7 @@ tensor_t minilm_embedder_forward(da_u32 ids, minilm_t weights);
 struct output_layer_t
 {
   tensor_t weight;   // [HIDDEN_SIZE, HIDDEN_SIZE]
+  tensor_packed_t weight_packed;
   tensor_t bias;     // [1, HIDDEN_SIZE]
   tensor_t ln_gamma; // [1, HIDDEN_SIZE]
   tensor_t ln_beta;  // [1, HIDDEN_SIZE]
@@ -97,12 +181,18 @@ typedef struct bert_layer_weigts_t
   tensor_t key_bias;   // [1, HIDDEN_SIZE]
   tensor_t value;      // [HIDDEN_SIZE, HIDDEN_SIZE]
   tensor_t value_bias; // [1, HIDDEN_SIZE]
+  // query, key and value fused by minilm_create into one [3 * HIDDEN_SIZE, HIDDEN_SIZE]
+  // linear layer, so the projections are a single GEMM; see tensor_pack_linear
+  tensor_packed_t qkv_packed;
+  tensor_t qkv_bias; // [3 * HIDDEN_SIZE], owned
+  uint32_t n_heads;  // from the TBF2 metadata, MINILM_DEFAULT_HEADS otherwise
   // output
   struct output_layer_t output;
   struct intermediate
   {
     tensor_t weight; // [HIDDEN_SIZE, INTERMEDIATE_SIZE]
     tensor_t bias;   // [1, INTERMEDIATE_SIZE]
+    tensor_packed_t weight_packed;
   } intermediate;
 
   struct output_layer_t output_2;
@@ -112,19 +202,23 @@ typedef struct minilm_t
 {
   TbfFile tf;
   tokenizer_t tokenizer;
+  pool_t *pool; // persistent workers for intra-op parallelism, NULL when single-threaded
+  // activation arenas, one per concurrent call, reused across calls; see minilm.c
+  struct minilm_workspaces_t *workspaces;
   // embeddings
   struct embeddings
   {
-    tensor_t word;     // [VOCAB_SIZE, HIDDEN_SIZE]
-    tensor_t pos;      // [MAX_POS,   HIDDEN_SIZE]
-    tensor_t type;     // [TOKEN_TYPES, HIDDEN_SIZE]
-    tensor_t ln_gamma; // [1, HIDDEN_SIZE]
-    tensor_t ln_beta;  // [1, HIDDEN_SIZE]
+    tensor_t word;       // [VOCAB_SIZE, HIDDEN_SIZE], float32, float16 or int8
+    tensor_t word_scale; // [VOCAB_SIZE] row scales of an int8 `word`, see scripts/tbf2.py --q8-embeddings
+    tensor_t pos;        // [MAX_POS,   HIDDEN_SIZE]
+    tensor_t type;       // [TOKEN_TYPES, HIDDEN_SIZE]
+    tensor_t ln_gamma;   // [1, HIDDEN_SIZE]
+    tensor_t ln_beta;    // [1, HIDDEN_SIZE]
   } embeddings;
 
   // encoder
   //  attention
-  bert_layer_weigts_t attention[6]; // 6 layers
+  bert_layer_weigts_t attention[MINILM_N_LAYERS];
   // intermediate
   tensor_t intermediate_weight; // [HIDDEN_SIZE, HIDDEN_SIZE]
   tensor_t intermediate_bias;   // [1, HIDDEN_SIZE]
@@ -136,7 +230,11 @@ typedef struct minilm_t
 } minilm_t;
 
 /// @brief Encoder layer forward (transformer layer) - for testing
-t_status minilm_encoder_forward(const tensor_t in, bert_layer_weigts_t weights, tensor_t *out);
+/// `out` follows tensor_ensure and must not live in `scratch`; temporaries are bump-allocated
+/// from `scratch` and released again before returning.
+t_status minilm_encoder_forward(const tensor_t in, nn_seqs_t seqs, bert_layer_weigts_t weights, tensor_t *out, arena_t *scratch, pool_t *pool);
 
 /// @brief Output layer forward (dense + residual + layer norm) - for testing
-t_status minilm_output_forward(tensor_t *out, const tensor_t hidden_states, const tensor_t input_tensor, struct output_layer_t params);
+/// The GEMM packs into `scratch` (NULL = allocated for the call).
+t_status minilm_output_forward(tensor_t *out, const tensor_t hidden_states, const tensor_t input_tensor, struct output_layer_t params,
+                               arena_t *scratch, pool_t *pool);
@@ -1,11 +1,22 @@
+#define _POSIX_C_SOURCE 200809L // mkdtemp
 #include "minilm.h"
 #include "tbf.h"
 #include "nn.h"
 #include "s8.h"
 #include "tokenizer.h"
+#include "autotune.h"
+#include "kernels.h"
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
 DA(tensor_t)
 
 void test_query()
@@ -96,9 +107,152 @@ void test_a()
     tensor_destroy(&test_tensor);
 }
 
+// Cosine similarity of the int8 embeddings to the float32 ones
+void test_int8_drift()
+{
+    static const char *texts[] = {
+        "a",
+        "paris",
+        "what's the capital of germany?",
+        "The quick brown fox jumps over the lazy dog.",
+        "Quantized linear layers trade a little accuracy for throughput on CPU fleets.",
+    };
+    const size_t n = sizeof(texts) / sizeof(texts[0]);
+    size_t lens[sizeof(texts) / sizeof(texts[0])];
+    for (size_t i = 0; i < n; i++)
+        lens[i] = strlen(texts[i]);
+
+    static float ref[5 * MINILM_HIDDEN_SIZE], q[5 * MINILM_HIDDEN_SIZE];
+    minilm_t m;
+    int err = minilm_create(&m, "../assets/bert_weights.tbf", "../assets/vocab.txt");
+    assert(!err);
+    t_status res = minilm_embed_batch(&m, texts, lens, n, ref);
+    assert(res == T_OK);
+    minilm_destroy(&m);
+    err = minilm_create_with_options(&m, "../assets/bert_weights.tbf", "../assets/vocab.txt",
+                                     (minilm_options_t){.n_threads = 1, .int8_linear = true});
+    assert(!err);
+    res = minilm_embed_batch(&m, texts, lens, n, q);
+    assert(res == T_OK);
+    minilm_destroy(&m);
+    (void)err, (void)res;
+
+    float worst = 1.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        float dot = 0.0f; // both normalized
+        for (size_t j = 0; j < MINILM_HIDDEN_SIZE; j++)
+            dot += ref[i * MINILM_HIDDEN_SIZE + j] * q[i * MINILM_HIDDEN_SIZE + j];
+        printf("int8 cosine %.6f  %s\n", dot, texts[i]);
+        worst = dot < worst ? dot : worst;
+    }
+    printf("int8 drift: min cosine %.6f\n", worst);
+    assert(worst > 0.999f);
+}
+
+// Batched and bulk embedding run the same encoder as per-text minilm_embed: only the GEMM
+// row blocking differs, so results agree to float rounding. Capitalized words tokenize to
+// id 0 ([UNK] is not lowercased away) and must not be treated as padding by either path.
+void test_batch_matches_single()
+{
+    static const char *texts[] = {
+        "The quick brown fox jumps over the lazy dog.",
+        "paris",
+        "What's the capital of Germany?",
+        "a",
+        "Batches group texts by length, so this longer sentence ends up in a different bucket than the short ones.",
+    };
+    const size_t n = sizeof(texts) / sizeof(texts[0]);
+    size_t lens[sizeof(texts) / sizeof(texts[0])];
+    for (size_t i = 0; i < n; i++)
+        lens[i] = strlen(texts[i]);
+
+    minilm_t m;
+    int err = minilm_create(&m, "../assets/bert_weights.tbf", "../assets/vocab.txt");
+    assert(!err);
+    static float single[5 * MINILM_HIDDEN_SIZE], batch[5 * MINILM_HIDDEN_SIZE], bulk[5 * MINILM_HIDDEN_SIZE];
+    t_status res;
+    for (size_t i = 0; i < n; i++)
+    {
+        tensor_t out;
+        res = minilm_embed(m, (char *)texts[i], lens[i], &out);
+        assert(res == T_OK);
+        memcpy(single + i * MINILM_HIDDEN_SIZE, out.data, MINILM_HIDDEN_SIZE * sizeof(float));
+        tensor_destroy(&out);
+    }
+    res = minilm_embed_batch(&m, texts, lens, n, batch);
+    assert(res == T_OK);
+    // the smallest budget puts every text in a batch of its own length bucket
+    res = minilm_embed_bulk(&m, texts, lens, n, MINILM_MAX_TOKENS, bulk);
+    assert(res == T_OK);
+    minilm_destroy(&m);
+    (void)err, (void)res;
+
+    float worst = 0.0f;
+    for (size_t i = 0; i < n * MINILM_HIDDEN_SIZE; i++)
+    {
+        worst = fmaxf(worst, fabsf(batch[i] - single[i]));
+        worst = fmaxf(worst, fabsf(bulk[i] - single[i]));
+    }
+    printf("batch/bulk vs single: max abs diff %.2e\n", worst);
+    assert(worst < 1e-5f);
+}
+
+// Tuning applies and caches a valid choice; the next call reads it back without timing
+void test_autotune()
+{
+    static const autotune_shape_t shapes[] = {{.K = 64, .N = 96}, {.K = 300, .N = 40}};
+    // the cache lands in a subdirectory of a fresh one, so autotune_gemm has to create it
+    char root[] = "/tmp/minilm_autotune_XXXXXX", dir[PATH_MAX], path[PATH_MAX];
+    char *made = mkdtemp(root);
+    assert(made);
+    int n = snprintf(dir, sizeof(dir), "%s/cache", root);
+    assert(n > 0 && (size_t)n < sizeof(dir));
+    const char *isa = kernels_get()->name;
+    autotune_result_t tuned, cached;
+    for (int w = AUTOTUNE_F32; w <= AUTOTUNE_I8; w++)
+    {
+        bool ok = autotune_gemm(shapes, 2, 32, (autotune_weights_t)w, dir, true, &tuned);
+        assert(ok && !tuned.cached && strcmp(tuned.isa, kernels_get()->name) == 0);
+        assert(gemm_get_tiling().mc == tuned.tiling.mc && gemm_get_tiling().kc == tuned.tiling.kc);
+
+        gemm_set_tiling((gemm_tiling_t){GEMM_MC, GEMM_KC});
+        ok = autotune_gemm(shapes, 2, 32, (autotune_weights_t)w, dir, false, &cached);
+        assert(ok && cached.cached && strcmp(cached.isa, tuned.isa) == 0);
+        assert(cached.tiling.mc == tuned.tiling.mc && cached.tiling.kc == tuned.tiling.kc);
+        assert(gemm_get_tiling().mc == tuned.tiling.mc && gemm_get_tiling().kc == tuned.tiling.kc);
+        printf("autotune %d: %s, %zu x %zu\n", w, tuned.isa, tuned.tiling.mc, tuned.tiling.kc);
+        (void)ok;
+    }
+    bool rejected = !gemm_set_tiling((gemm_tiling_t){GEMM_MC_MAX + 1, GEMM_KC});
+    gemm_set_tiling((gemm_tiling_t){GEMM_MC, GEMM_KC});
+    bool restored = kernels_use(isa);
+    assert(rejected && restored);
+
+    // clean up outside the asserts so an NDEBUG build does not leave the directory behind
+    int failed = 0;
+    DIR *d = opendir(dir);
+    assert(d);
+    for (struct dirent *e; d && (e = readdir(d));)
+        if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0)
+        {
+            n = snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            failed |= n < 0 || (size_t)n >= sizeof(path) || remove(path) != 0;
+        }
+    if (d)
+        closedir(d);
+    failed |= rmdir(dir) != 0;
+    failed |= rmdir(root) != 0;
+    assert(!failed);
+    (void)made, (void)rejected, (void)restored, (void)failed;
+}
+
 int main(int argc, char **argv)
 {
+    test_autotune();
     test_query();
     test_a();
+    test_int8_drift();
+    test_batch_matches_single();
     return 0;
 }
\ No newline at end of file
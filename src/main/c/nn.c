@@ -6,10 +6,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include "tensor.h"
+#include "kernels.h"
 
-void nn_embeddings_forward(tensor_t *out, const uint32_t *ids, size_t num_tokens, tensor_t weights)
+t_status nn_embeddings_forward(tensor_t *out, const uint32_t *ids, size_t num_tokens, tensor_t weights)
 {
-    *out = tensor_create(2, (uint32_t[]){num_tokens, weights.dims[1]});
+    m_try(tensor_ensure(out, 2, (uint32_t[]){num_tokens, weights.dims[1]}));
     for (size_t i = 0; i < num_tokens; i++)
     {
         uint32_t id = ids[i];
@@ -17,100 +18,164 @@ void nn_embeddings_forward(tensor_t *out, const uint32_t *ids, size_t num_tokens
         tensor_t src_view = tensor_slice(&weights, 0, id, true);
         memcpy(dst_view.data, src_view.data, src_view.dims[1] * sizeof(float));
     }
+    return T_OK;
 }
 
-float nn_mean(tensor_t x)
+typedef struct
+{
+    const kernels_t *kern;
+    tensor_t out;
+    tensor_t x;
+    tensor_t gamma;
+    tensor_t beta;
+    size_t rows_per_task;
+} layer_norm_job_t;
+
+static void layer_norm_task(void *arg, size_t task)
 {
-    return tensor_sum(x) / (float)x.dims[0];
+    const layer_norm_job_t *job = (const layer_norm_job_t *)arg;
+    const size_t n = job->x.dims[1];
+    const size_t t0 = task * job->rows_per_task;
+    const size_t t1 = t0 + job->rows_per_task < job->x.dims[0] ? t0 + job->rows_per_task : job->x.dims[0];
+    for (size_t t = t0; t < t1; ++t)
+        job->kern->layer_norm_row(job->out.data + t * job->out.strides[0], job->x.data + t * job->x.strides[0],
+                                  job->gamma.data, job->beta.data, n, 1e-12f);
 }
 
 t_status nn_layer_norm_forward(
     tensor_t *out,
     tensor_t x,
     tensor_t gamma, // [1, HIDDEN_SIZE]
-    tensor_t beta)
+    tensor_t beta,
+    pool_t *pool)
 {
-    float eps = 1e-12f;
-    // assert(gamma.cols == HIDDEN_SIZE && beta.cols == HIDDEN_SIZE);
+    const size_t rows = x.dims[0], n = x.dims[1];
+    if (x.ndim != 2 || tensor_numel(gamma) != n || tensor_numel(beta) != n)
+        return T_ERR;
+
+    const size_t threads = pool_size(pool);
+    layer_norm_job_t job = {
+        .kern = kernels_get(),
+        .out = *out,
+        .x = x,
+        .gamma = gamma,
+        .beta = beta,
+        .rows_per_task = (rows + threads - 1) / threads,
+    };
+    if (rows == 0)
+        return T_OK;
+    pool_run(pool, (rows + job.rows_per_task - 1) / job.rows_per_task, layer_norm_task, &job);
+    return T_OK;
+}
 
-    float *xd = x.data;
+t_status nn_layer_norm_inplace(tensor_t x, tensor_t gamma, tensor_t beta, pool_t *pool)
+{
+    return nn_layer_norm_forward(&x, x, gamma, beta, pool);
+}
 
-    for (size_t t = 0; t < x.dims[0]; ++t)
+t_status nn_linear_forward(tensor_t *out,           // [S,HIDDEN_SIZE]
+                           tensor_t x,              // [S,HIDDEN_SIZE]
+                           tensor_packed_t weights, // [HIDDEN_SIZE, HIDDEN_SIZE]
+                           tensor_t bias,           // [1, HIDDEN_SIZE]
+                           arena_t *scratch,
+                           pool_t *pool)
+{
+    return nn_linear_fused_forward(out, x, weights, bias, NN_ACT_NONE, NULL, scratch, pool);
+}
+
+t_status nn_linear_fused_forward(tensor_t *out,
+                                 tensor_t x,
+                                 tensor_packed_t weights,
+                                 tensor_t bias,
+                                 nn_act_t act,
+                                 const tensor_t *residual,
+                                 arena_t *scratch,
+                                 pool_t *pool)
+{
+    if (tensor_numel(bias) != weights.N)
+        return T_ERR;
+    static const gemm_act_t gemm_act[] = {
+        [NN_ACT_NONE] = GEMM_ACT_NONE,
+        [NN_ACT_GELU] = GEMM_ACT_GELU,
+        [NN_ACT_GELU_ERF] = GEMM_ACT_GELU_ERF,
+    };
+    gemm_epilogue_t epi = {.bias = bias.data, .act = gemm_act[act]};
+    if (residual)
     {
-        // Debug: check dimensions before slice
-        if (t >= x.dims[0]) {
-            fprintf(stderr, "[C] layer_norm: Invalid slice t=%zu, x.dims[0]=%u\n", t, x.dims[0]);
+        if (residual->ndim != 2 || residual->dims[0] != x.dims[0] || residual->dims[1] != weights.N ||
+            residual->strides[1] != 1)
             return T_ERR;
-        }
-        tensor_t x_view = tensor_slice(&x, 0, t, false);
-
-        // // 1) mean over features
-        float mean = nn_mean(x_view);
-
-        // // 2) variance over features
-        tensor_t x_view_copy = tensor_copy(x_view);
-        tensor_unary_op(x_view_copy, U_SUB, &mean);
-        float op_param = 2.0f;
-        tensor_unary_op(x_view_copy, U_POW, &op_param);
-        float var = tensor_sum(x_view_copy);
-        var /= (float)x_view_copy.dims[0];
-
-        // 3) normalize, then scale & shift
-        float inv_std = 1.0f / sqrtf(var + eps);
-        
-        tensor_t x_view_copy2 = tensor_copy(x_view);
-        tensor_unary_op(x_view_copy2, U_SUB, &mean);
-        tensor_unary_op(x_view_copy2, U_SCALE, &inv_std);
-        tensor_binary_op(x_view_copy2, gamma, B_MUL);
-        tensor_binary_op(x_view_copy2, beta, B_ADD);
-
-        tensor_t out_view = tensor_slice(out, 0, t, true);
-        memcpy(out_view.data, x_view_copy2.data, tensor_numel(x_view_copy2) * sizeof(float));
-
-        tensor_destroy(&x_view_copy);
-        tensor_destroy(&x_view_copy2);
+        epi.residual = residual->data;
+        epi.ld_residual = residual->strides[0];
     }
-    return T_OK;
+    return tensor_matmul_packed(out, x, weights, &epi, scratch, pool);
 }
 
-t_status nn_linear_forward(tensor_t *out,    // [S,HIDDEN_SIZE]
-                           tensor_t x,       // [S,HIDDEN_SIZE]
-                           tensor_t weights, // [HIDDEN_SIZE, HIDDEN_SIZE]
-                           tensor_t bias     // [1, HIDDEN_SIZE]
-)
-{
-    tensor_t weights_T;
-    m_try(tensor_permute(&weights_T, weights, 0, 1));
-    m_try(tensor_matmul(out, x, weights_T));
-    tensor_destroy(&weights_T);
-    tensor_binary_op(*out, bias, B_ADD);
-    return T_OK;
+typedef struct
+{
+    const kernels_t *kern;
+    float *x;
+    size_t n;
+    size_t chunk;
+} gelu_job_t;
+
+static void gelu_task(void *arg, size_t task)
+{
+    const gelu_job_t *job = (const gelu_job_t *)arg;
+    const size_t i0 = task * job->chunk;
+    const size_t len = i0 + job->chunk < job->n ? job->chunk : job->n - i0;
+    job->kern->gelu(job->x + i0, len);
 }
-void nn_softmax(tensor_t t)
+
+void nn_gelu_forward(tensor_t x, pool_t *pool)
 {
-    tensor_unary_op(t, U_EXP, NULL);
-    float sum = tensor_sum(t);
-    float scale = 1.0f / sum;
-    tensor_unary_op(t, U_SCALE, &scale);
+    const size_t n = tensor_numel(x);
+    const size_t threads = pool_size(pool);
+    // 64-float aligned chunks so no two tasks share a cache line
+    const size_t chunk = ((n + threads - 1) / threads + 63) & ~(size_t)63;
+    gelu_job_t job = {.kern = kernels_get(), .x = x.data, .n = n, .chunk = chunk};
+    if (n == 0)
+        return;
+    pool_run(pool, (n + chunk - 1) / chunk, gelu_task, &job);
 }
 
-#define m_len(x) (sizeof(x) / sizeof(x[0]))
+// query rows per attention task; small enough to spread a single sequence over the pool
+#define NN_ATTN_QUERY_BLOCK 32
 
-t_status tensor_bmm(tensor_t *out, tensor_t A, tensor_t B)
+typedef struct
 {
-    *out = tensor_create(3, (uint32_t[]){A.dims[0], A.dims[1], B.dims[2]});
-    for (size_t i = 0; i < A.dims[0]; i++)
-    {
-        tensor_t a = tensor_slice(&A, 0, i, false);
-        tensor_t b = tensor_slice(&B, 0, i, false);
-        tensor_t tmp;
-        m_try(tensor_matmul(&tmp, a, b));
-
-        tensor_t out_view = tensor_slice(out, 0, i, false);
-        memcpy(out_view.data, tmp.data, tensor_numel(tmp) * sizeof(float));
-        tensor_destroy(&tmp);
-    }
-    return T_OK;
+    uint32_t seq;
+    uint32_t row0;
+    uint32_t rows;
+} attention_block_t;
+
+typedef struct
+{
+    const kernels_t *kern;
+    nn_seqs_t seqs;
+    const attention_block_t *blocks;
+    uint32_t num_heads;
+    uint32_t head_size;
+    tensor_t q;   // [T, H * D], read by head stride
+    tensor_t k;   // [T, H * D]
+    tensor_t v;   // [T, H * D]
+    tensor_t out; // [T, H * D]
+    float scale;
+} attention_job_t;
+
+// one block of query rows of one sequence against all of that sequence's keys, one head
+static void attention_task(void *arg, size_t task)
+{
+    const attention_job_t *job = (const attention_job_t *)arg;
+    const attention_block_t blk = job->blocks[task / job->num_heads];
+    const size_t col = (task % job->num_heads) * job->head_size;
+    const size_t kv0 = job->seqs.offsets[blk.seq], n_kv = job->seqs.offsets[blk.seq + 1] - kv0;
+    const size_t ldq = job->q.strides[0], ldkv = job->k.strides[0], ldo = job->out.strides[0];
+
+    job->kern->attention(job->q.data + blk.row0 * ldq + col, ldq, blk.rows,
+                         job->k.data + kv0 * ldkv + col, job->v.data + kv0 * ldkv + col, ldkv, n_kv,
+                         job->seqs.mask ? job->seqs.mask + kv0 : NULL, job->scale,
+                         job->out.data + blk.row0 * ldo + col, ldo, job->head_size);
 }
 
 t_status nn_dot_product_attention_forward(
@@ -118,88 +183,91 @@ t_status nn_dot_product_attention_forward(
     tensor_t query_tensor,
     tensor_t key_tensor,
     tensor_t value_tensor,
-    uint32_t n_attention_heads)
+    nn_seqs_t seqs,
+    uint32_t n_attention_heads,
+    arena_t *scratch,
+    pool_t *pool)
 {
-    int ret;
-    uint32_t num_tokens = query_tensor.dims[0];
-    uint32_t num_heads = n_attention_heads;
-    uint32_t head_size = query_tensor.dims[1] / num_heads;
-    uint32_t dims[3] = {num_tokens, num_heads, head_size};
-    tensor_t qt = tensor_view(m_len(dims), dims, query_tensor.data);
-    tensor_t kt = tensor_view(m_len(dims), dims, key_tensor.data);
-    tensor_t vt = tensor_view(m_len(dims), dims, value_tensor.data);
-
-    tensor_t qtv_T, kt_T, vt_T;
-    m_try(tensor_permute(&qtv_T, qt, 0, 1)); // [12, 128, 32]
-    m_try(tensor_permute(&qt, qtv_T, 1, 2)); // [12, 32, 128]
-    m_try(tensor_permute(&kt_T, kt, 0, 1));  // [12, 128, 32]
-    m_try(tensor_permute(&kt, kt_T, 1, 2));  // [12, 32, 128]
-    m_try(tensor_permute(&vt_T, vt, 0, 1));  // [12, 128, 32]
-    m_try(tensor_permute(&vt, vt_T, 1, 2));  // [12, 32, 128]
-
-    tensor_t out_tensor_3d;
-
-    m_try(tensor_bmm(&out_tensor_3d, qtv_T, kt));
-
-    float scale = 1.0f / sqrtf((float)head_size);
-    tensor_unary_op(out_tensor_3d, U_SCALE, &scale);
-
-    // softmax
-
-    for (size_t i = 0; i < out_tensor_3d.dims[0]; i++)
-    {
-        tensor_t a = tensor_slice(&out_tensor_3d, 0, i, true);
-        for (size_t j = 0; j < out_tensor_3d.dims[1]; j++)
+    const uint32_t num_tokens = query_tensor.dims[0];
+    const uint32_t hidden = query_tensor.dims[1];
+    if (n_attention_heads == 0 || hidden % n_attention_heads != 0)
+        return T_ERR;
+    const uint32_t head_size = hidden / n_attention_heads;
+    if (seqs.n == 0 || seqs.offsets[0] != 0 || seqs.offsets[seqs.n] != num_tokens)
+        return T_ERR;
+    if (head_size > KERNELS_ATTN_MAX_D || key_tensor.strides[0] != value_tensor.strides[0])
+        return T_ERR;
+
+    // split every sequence into query blocks; each (block, head) pair is one task
+    size_t n_blocks = 0;
+    for (size_t b = 0; b < seqs.n; b++)
+        n_blocks += (seqs.offsets[b + 1] - seqs.offsets[b] + NN_ATTN_QUERY_BLOCK - 1) / NN_ATTN_QUERY_BLOCK;
+    m_try(tensor_ensure(out, 2, (uint32_t[]){num_tokens, hidden}));
+    const size_t mark = arena_mark(scratch);
+    attention_block_t *blocks = (attention_block_t *)arena_alloc(scratch, n_blocks * sizeof(attention_block_t));
+    if (!blocks)
+        return T_ERR;
+    size_t i = 0;
+    for (uint32_t b = 0; b < seqs.n; b++)
+        for (uint32_t r = seqs.offsets[b]; r < seqs.offsets[b + 1]; r += NN_ATTN_QUERY_BLOCK)
         {
-            tensor_t b = tensor_slice(&a, 1, j, true);
-            nn_softmax(b);
+            const uint32_t left = seqs.offsets[b + 1] - r;
+            blocks[i++] = (attention_block_t){.seq = b, .row0 = r, .rows = left < NN_ATTN_QUERY_BLOCK ? left : NN_ATTN_QUERY_BLOCK};
         }
-    }
-
-    tensor_t attn_tensor;
-
-    m_try(tensor_bmm(&attn_tensor, out_tensor_3d, vt_T));
 
-    tensor_t attn_tensor_T;
-    m_try(tensor_permute(&attn_tensor_T, attn_tensor, 0, 1));
-
-    tensor_destroy(&attn_tensor);
-    tensor_destroy(&out_tensor_3d);
-    tensor_destroy(&qtv_T);
-    tensor_destroy(&kt_T);
-    tensor_destroy(&vt_T);
-
-    tensor_t attn_tensor_view = tensor_view(2, (uint32_t[]){num_tokens, 384}, attn_tensor_T.data);
-    *out = attn_tensor_view;
+    attention_job_t job = {
+        .kern = kernels_get(),
+        .seqs = seqs,
+        .blocks = blocks,
+        .num_heads = n_attention_heads,
+        .head_size = head_size,
+        .q = query_tensor,
+        .k = key_tensor,
+        .v = value_tensor,
+        .out = *out,
+        .scale = 1.0f / sqrtf((float)head_size),
+    };
+    pool_run(pool, n_blocks * n_attention_heads, attention_task, &job);
+
+    arena_rewind(scratch, mark);
     return T_OK;
 }
 
-void nn_mean_pooling(tensor_t *out, tensor_t in, tensor_t attention_mask)
+size_t nn_attention_scratch_bytes(size_t num_tokens)
 {
-    tensor_t row_0 = tensor_slice(&in, 0, 0, true);
-    tensor_t row_1 = tensor_slice(&in, 0, 1, true);
-    tensor_t row_2 = tensor_slice(&in, 0, 2, true);
+    // every sequence has at least one token, and adds at most one partial block
+    const size_t max_blocks = num_tokens + num_tokens / NN_ATTN_QUERY_BLOCK;
+    return arena_footprint(max_blocks * sizeof(attention_block_t));
+}
 
-    *out = tensor_copy(row_0);
+t_status nn_mean_pooling(tensor_t *out, tensor_t in, tensor_t attention_mask)
+{
+    const size_t rows = in.dims[0], n = in.dims[1];
+    assert(!attention_mask.data || tensor_numel(attention_mask) == rows);
+    m_try(tensor_ensure(out, 2, (uint32_t[]){1, n}));
+    memset(out->data, 0, n * sizeof(float));
 
-    // average
-    tensor_binary_op(*out, row_1, B_ADD);
-    tensor_binary_op(*out, row_2, B_ADD);
-    float scale = 1.0f / 3.0f;
+    float count = 0.0f;
+    for (size_t r = 0; r < rows; r++)
+    {
+        const float w = attention_mask.data ? attention_mask.data[r] : 1.0f;
+        if (w == 0.0f)
+            continue;
+        const float *row = in.data + r * in.strides[0];
+        float *acc = out->data;
+        TENSOR_MAP(i, n, acc[i] += w * row[i]);
+        count += w;
+    }
+
+    float scale = 1.0f / fmaxf(count, 1e-9f);
     tensor_unary_op(*out, U_SCALE, &scale);
+    return T_OK;
 }
 
 void nn_normalize(tensor_t *t)
 {
-    float p = 2.0f;
-
-    tensor_t t_pow = tensor_copy(*t);
-    tensor_unary_op(t_pow, U_POW, &p);
-
-    float norm = tensor_sum(t_pow);
-    norm = powf(norm, 1.0f / p);
+    const size_t n = tensor_numel(*t);
+    float norm = sqrtf(kernels_get()->dot(t->data, t->data, n));
     float scale = 1.0f / norm;
     tensor_unary_op(*t, U_SCALE, &scale);
-
-    tensor_destroy(&t_pow);
 }
\ No newline at end of file
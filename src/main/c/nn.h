@@ -1,42 +1,107 @@
 #pragma once
 #include <stddef.h>
 #include "tensor.h"
+#include "arena.h"
+
+/// Sequences stacked along the token axis of a [T, HIDDEN_SIZE] activation.
+/// Sequence i owns rows [offsets[i], offsets[i + 1]); tokens of different sequences
+/// never attend to each other.
+typedef struct nn_seqs_t
+{
+    uint32_t n;              // number of sequences
+    const uint32_t *offsets; // [n + 1], offsets[0] == 0, offsets[n] == T
+    const float *mask;       // [T], 1 = token, 0 = padding; NULL when nothing is padded
+} nn_seqs_t;
 
 /// ```python
 /// out = weights[ids]
 /// ```
-void nn_embeddings_forward(tensor_t *out, const uint32_t *ids, size_t num_tokens, tensor_t weights);
+/// Functions here that take `tensor_t *out` create it unless it is already backed by a
+/// buffer (e.g. an arena), see tensor_ensure.
+t_status nn_embeddings_forward(tensor_t *out, const uint32_t *ids, size_t num_tokens, tensor_t weights);
 
 /// ```python
 /// out = (x - mean(x)) / std(x) * gamma + beta
 /// ```
-t_status nn_layer_norm_forward(tensor_t *out, tensor_t x_tensor, tensor_t gamma, tensor_t beta);
+/// Rows are split across `pool` (NULL = single-threaded); `out` may be `x`.
+/// Each row is one statistics pass and one output pass of the layer_norm_row kernel, no allocation.
+t_status nn_layer_norm_forward(tensor_t *out, tensor_t x_tensor, tensor_t gamma, tensor_t beta, pool_t *pool);
+
+/// @brief nn_layer_norm_forward writing the result back into `x`
+t_status nn_layer_norm_inplace(tensor_t x, tensor_t gamma, tensor_t beta, pool_t *pool);
+
+/// ```python
+/// out = x @ weights.T + bias
+/// ```
+/// `weights` is packed once at load time, see tensor_pack_linear. Up to GEMM_SKINNY_MAX rows
+/// (a short query) run on the skinny GEMM, more on the blocked one, which packs into
+/// `scratch` (NULL = allocated for the call, see tensor_matmul_packed).
+t_status nn_linear_forward(tensor_t *out,           // [S,HIDDEN_SIZE]
+                           tensor_t x,              // [S,HIDDEN_SIZE]
+                           tensor_packed_t weights, // [HIDDEN_SIZE, HIDDEN_SIZE]
+                           tensor_t bias,           // [1, HIDDEN_SIZE]
+                           arena_t *scratch,
+                           pool_t *pool);
+
+/// Activation applied by nn_linear_fused_forward
+typedef enum nn_act_t
+{
+    NN_ACT_NONE,
+    NN_ACT_GELU,     // tanh approximation
+    NN_ACT_GELU_ERF, // exact: 0.5 * x * (1 + erf(x / sqrt(2)))
+} nn_act_t;
+
+/// ```python
+/// out = act(x @ weights.T + bias) + residual
+/// ```
+/// Bias, activation and residual run in the GEMM epilogue on each output tile, so the
+/// result is written once. `residual` ([S, N], may be NULL) must not be `out`.
+t_status nn_linear_fused_forward(tensor_t *out,
+                                 tensor_t x,
+                                 tensor_packed_t weights,
+                                 tensor_t bias,
+                                 nn_act_t act,
+                                 const tensor_t *residual,
+                                 arena_t *scratch,
+                                 pool_t *pool);
 
 /// ```python
-/// out = x @ weights + bias
+/// x = gelu(x)  # tanh approximation, in place
 /// ```
-t_status nn_linear_forward(tensor_t *out,    // [S,HIDDEN_SIZE]
-                           tensor_t x,       // [S,HIDDEN_SIZE]
-                           tensor_t weights, // [HIDDEN_SIZE, HIDDEN_SIZE]
-                           tensor_t bias);   // [1, HIDDEN_SIZE]
+void nn_gelu_forward(tensor_t x, pool_t *pool);
 
 /// PyTorch reference:
 /// ```python
-/// def dot_product_attention(query, key, value):
+/// def dot_product_attention(query, key, value, attention_mask):
 ///     scale_factor = 1 / math.sqrt(query.size(-1))
 ///     attn_weight = query @ key.transpose(-2, -1) * scale_factor
+///     attn_weight = attn_weight.masked_fill(attention_mask == 0, -inf)
 ///     attn_weight = torch.softmax(attn_weight, dim=-1)
 ///     return attn_weight @ value
 /// ```
+/// Evaluated independently for every sequence in `seqs`, with `seqs.mask` as the key mask.
+/// Fused: heads are read in place from the [T, H * D] projections through their row stride
+/// (strides[0], so column views of a wider tensor work) and written straight into `out`;
+/// softmax is computed online over key tiles, so no score matrix is materialized.
+/// The task list comes from `scratch` and is released before returning.
 t_status nn_dot_product_attention_forward(
     tensor_t *out,
     tensor_t query_tensor,
     tensor_t key_tensor,
     tensor_t value_tensor,
-    uint32_t n_attention_heads);
+    nn_seqs_t seqs,
+    uint32_t n_attention_heads,
+    arena_t *scratch,
+    pool_t *pool); // one task per (query block, head)
 
-/// mean with mask
-void nn_mean_pooling(tensor_t *out, tensor_t in, tensor_t attention_mask);
+/// @brief Scratch bytes nn_dot_product_attention_forward takes for `num_tokens` tokens, any split into sequences
+size_t nn_attention_scratch_bytes(size_t num_tokens);
+
+/// ```python
+/// out = (in * attention_mask[:, None]).sum(0) / attention_mask.sum().clamp(min=1e-9)
+/// ```
+/// `in` is [S, HIDDEN_SIZE], `attention_mask` is [S] or a zeroed tensor_t (plain mean); `out` is [1, HIDDEN_SIZE]
+t_status nn_mean_pooling(tensor_t *out, tensor_t in, tensor_t attention_mask);
 
 /// ```python
 /// out = (t - mean(t)) / std(t)
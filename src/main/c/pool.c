@@ -0,0 +1,166 @@
+// pool.c — persistent pthread worker pool
+#include "pool.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+struct pool_t
+{
+    size_t n_workers;
+    pthread_t *workers;
+
+    pthread_mutex_t submit; // held for the whole job, see pool_run
+    pthread_mutex_t mu;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    // current job, published under mu by bumping generation
+    uint64_t generation;
+    pool_fn fn;
+    void *arg;
+    size_t n_tasks;
+    atomic_size_t next_task;
+    size_t active; // workers that have not finished the current job
+    bool stop;
+    atomic_size_t n_started; // hands out the worker indices, see pool_thread_index
+};
+
+// the pool the current thread works for and its index there, see pool_thread_index
+static _Thread_local const pool_t *worker_pool;
+static _Thread_local size_t worker_index;
+
+static void pool_work(pool_t *p)
+{
+    for (;;)
+    {
+        const size_t task = atomic_fetch_add_explicit(&p->next_task, 1, memory_order_relaxed);
+        if (task >= p->n_tasks)
+            return;
+        p->fn(p->arg, task);
+    }
+}
+
+static void *pool_worker(void *arg)
+{
+    pool_t *p = (pool_t *)arg;
+    uint64_t seen = 0;
+    worker_pool = p;
+    worker_index = atomic_fetch_add_explicit(&p->n_started, 1, memory_order_relaxed) + 1;
+
+    pthread_mutex_lock(&p->mu);
+    for (;;)
+    {
+        while (p->generation == seen && !p->stop)
+            pthread_cond_wait(&p->wake, &p->mu);
+        if (p->stop)
+            break;
+        seen = p->generation;
+        pthread_mutex_unlock(&p->mu);
+
+        pool_work(p);
+
+        pthread_mutex_lock(&p->mu);
+        if (--p->active == 0)
+            pthread_cond_signal(&p->done);
+    }
+    pthread_mutex_unlock(&p->mu);
+    return NULL;
+}
+
+pool_t *pool_create(size_t n_threads)
+{
+    if (n_threads == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        n_threads = online > 0 ? (size_t)online : 1;
+    }
+
+    pool_t *p = (pool_t *)calloc(1, sizeof(pool_t));
+    if (!p)
+        return NULL;
+    pthread_mutex_init(&p->submit, NULL);
+    pthread_mutex_init(&p->mu, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->done, NULL);
+    atomic_init(&p->next_task, 0);
+    atomic_init(&p->n_started, 0);
+
+    p->workers = (pthread_t *)calloc(n_threads, sizeof(pthread_t));
+    if (!p->workers)
+    {
+        pool_destroy(p);
+        return NULL;
+    }
+    for (size_t i = 0; i + 1 < n_threads; ++i)
+    {
+        if (pthread_create(&p->workers[i], NULL, pool_worker, p) != 0)
+        {
+            pool_destroy(p);
+            return NULL;
+        }
+        p->n_workers++;
+    }
+    return p;
+}
+
+void pool_destroy(pool_t *p)
+{
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->mu);
+    p->stop = true;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->mu);
+    for (size_t i = 0; i < p->n_workers; ++i)
+        pthread_join(p->workers[i], NULL);
+
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->mu);
+    pthread_mutex_destroy(&p->submit);
+    free(p->workers);
+    free(p);
+}
+
+size_t pool_size(const pool_t *p)
+{
+    return p ? p->n_workers + 1 : 1;
+}
+
+size_t pool_thread_index(const pool_t *p)
+{
+    return p && worker_pool == p ? worker_index : 0;
+}
+
+void pool_run(pool_t *p, size_t n_tasks, pool_fn fn, void *arg)
+{
+    if (!p || p->n_workers == 0 || n_tasks <= 1 || pthread_mutex_trylock(&p->submit) != 0)
+    {
+        for (size_t i = 0; i < n_tasks; ++i)
+            fn(arg, i);
+        return;
+    }
+
+    pthread_mutex_lock(&p->mu);
+    p->fn = fn;
+    p->arg = arg;
+    p->n_tasks = n_tasks;
+    atomic_store_explicit(&p->next_task, 0, memory_order_relaxed);
+    p->active = p->n_workers;
+    p->generation++;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->mu);
+
+    // the caller is one of the threads
+    pool_work(p);
+
+    pthread_mutex_lock(&p->mu);
+    while (p->active > 0)
+        pthread_cond_wait(&p->done, &p->mu);
+    pthread_mutex_unlock(&p->mu);
+
+    pthread_mutex_unlock(&p->submit);
+}
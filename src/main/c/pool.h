@@ -0,0 +1,34 @@
+#pragma once
+#include <stddef.h>
+
+/// Persistent worker pool for intra-op parallelism.
+///
+/// Workers are started once and sleep between jobs. A job is `n_tasks` calls of
+/// `fn(arg, task)`, claimed dynamically by the workers and the calling thread.
+/// Only one job runs at a time: a pool_run issued while another is in flight
+/// (a concurrent caller, or a nested call from inside a task) runs inline on the
+/// calling thread instead of waiting, so nesting can never deadlock.
+typedef struct pool_t pool_t;
+
+typedef void (*pool_fn)(void *arg, size_t task);
+
+/// @brief Create a pool running jobs on `n_threads` threads including the caller.
+/// @param n_threads 0 = number of online CPUs, 1 = no workers (everything inline)
+/// @return NULL on error
+pool_t *pool_create(size_t n_threads);
+
+/// @brief Stop and join the workers. NULL is allowed.
+void pool_destroy(pool_t *p);
+
+/// @brief Threads a job can use, including the caller (1 for a NULL pool)
+size_t pool_size(const pool_t *p);
+
+/// @brief Index of the calling thread among the threads of a job of `p`, in [0, pool_size(p)):
+/// i + 1 on worker i, 0 on any other thread (the one that called pool_run). Tasks of one job
+/// that run at the same time see different indices, so a job can give each thread its own
+/// slice of a buffer.
+size_t pool_thread_index(const pool_t *p);
+
+/// @brief Run fn(arg, i) for every i in [0, n_tasks) and wait for all of them.
+/// A NULL pool runs the tasks inline, in order.
+void pool_run(pool_t *p, size_t n_tasks, pool_fn fn, void *arg);
@@ -1,8 +1,15 @@
+// tbf.c — TBF weight file reader (TBF1 and TBF2)
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "tbf.h"
+#include "f16.h"
 
 static int read_exact(void *dst, size_t sz, FILE *fp)
 {
@@ -10,6 +17,124 @@ static int read_exact(void *dst, size_t sz, FILE *fp)
 }
 
 t_status tbf_open(TbfFile *tf, const char *path)
+{
+    return tbf_open_with(tf, path, TBF_LOAD_COPY);
+}
+
+// Maps the whole file read-only; the mapping outlives the descriptor
+static t_status tbf_map(TbfFile *tf, FILE *fp)
+{
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size <= 0)
+        return T_ERR;
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fileno(fp), 0);
+    if (map == MAP_FAILED)
+        return T_ERR;
+    tf->map = map;
+    tf->map_size = (size_t)st.st_size;
+    return T_OK;
+}
+
+static bool tbf_owns_data(TbfFile tf, const tensor_t *t)
+{
+    const uint8_t *p = (const uint8_t *)t->data, *base = (const uint8_t *)tf.map;
+    return p && !(base && p >= base && p < base + tf.map_size);
+}
+
+static uint32_t tbf_name_hash(const char *name)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const uint8_t *p = (const uint8_t *)name; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+// CRC-32 (IEEE 802.3, reflected), same as zlib.crc32
+static void tbf_crc32_table(uint32_t table[256])
+{
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        table[i] = c;
+    }
+}
+
+static uint32_t tbf_crc32(const uint32_t table[256], const void *data, size_t n)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const uint8_t *p = (const uint8_t *)data, *end = p + n; p < end; p++)
+        crc = table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Open-addressed name -> tensor directory for files that do not carry one (TBF1)
+static t_status tbf_build_index(TbfFile *tf)
+{
+    uint32_t slots = 16;
+    while (slots < 2 * tf->count)
+        slots *= 2;
+    tf->index = (uint32_t *)calloc(slots, sizeof(uint32_t));
+    if (!tf->index)
+        return T_ERR;
+    tf->index_slots = slots;
+    for (uint64_t i = 0; i < tf->count; i++)
+    {
+        uint32_t s = tbf_name_hash(tf->tensors[i].name) & (slots - 1);
+        while (tf->index[s])
+            s = (s + 1) & (slots - 1);
+        tf->index[s] = (uint32_t)i + 1;
+    }
+    return T_OK;
+}
+
+static void tbf_set_meta(tbf_meta_t *meta, const char *key, int64_t value)
+{
+    static const struct
+    {
+        const char *key;
+        size_t offset;
+    } fields[] = {
+        {"n_layers", offsetof(tbf_meta_t, n_layers)},
+        {"n_heads", offsetof(tbf_meta_t, n_heads)},
+        {"hidden_size", offsetof(tbf_meta_t, hidden_size)},
+        {"intermediate_size", offsetof(tbf_meta_t, intermediate_size)},
+        {"vocab_size", offsetof(tbf_meta_t, vocab_size)},
+        {"max_positions", offsetof(tbf_meta_t, max_positions)},
+    };
+    // unknown keys are ignored so writers can add fields
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+        if (strcmp(fields[i].key, key) == 0 && value >= 0 && value <= UINT32_MAX)
+            *(uint32_t *)((uint8_t *)meta + fields[i].offset) = (uint32_t)value;
+}
+
+// TBF2 header after the magic: header size, counts and the metadata block
+static t_status tbf2_read_preamble(TbfFile *tf, FILE *fp, uint64_t *count, uint32_t *data_start)
+{
+    uint32_t n_meta;
+    if (read_exact(data_start, 4, fp) < 0 || read_exact(count, 8, fp) < 0 ||
+        read_exact(&n_meta, 4, fp) < 0 || read_exact(&tf->index_slots, 4, fp) < 0)
+        return T_ERR;
+    if (tf->index_slots == 0 || (tf->index_slots & (tf->index_slots - 1)) || tf->index_slots < *count)
+        return T_ERR;
+
+    for (uint32_t i = 0; i < n_meta; i++)
+    {
+        uint16_t key_len;
+        char key[TENSOR_MAX_NAME_LEN];
+        int64_t value;
+        if (read_exact(&key_len, 2, fp) < 0 || key_len >= sizeof(key) ||
+            read_exact(key, key_len, fp) < 0 || read_exact(&value, 8, fp) < 0)
+            return T_ERR;
+        key[key_len] = '\0';
+        tbf_set_meta(&tf->meta, key, value);
+    }
+    return T_OK;
+}
+
+t_status tbf_open_with(TbfFile *tf, const char *path, tbf_load_t mode)
 {
     FILE *fp = fopen(path, "rb");
     if (!fp)
@@ -19,30 +144,48 @@ t_status tbf_open(TbfFile *tf, const char *path)
     }
 
     char magic[4];
-    if (read_exact(magic, 4, fp) < 0 || memcmp(magic, "TBF1", 4) != 0)
+    if (read_exact(magic, 4, fp) < 0)
     {
         fclose(fp);
         return T_ERR;
     }
-
-    uint64_t count;
-    if (read_exact(&count, 8, fp) < 0)
+    uint32_t version = 0;
+    if (memcmp(magic, "TBF1", 4) == 0)
+        version = 1;
+    else if (memcmp(magic, "TBF2", 4) == 0)
+        version = 2;
+    if (version == 0)
     {
         fclose(fp);
         return T_ERR;
     }
 
+    *tf = (TbfFile){.fp = fp, .version = version};
+    uint64_t count;
+    uint32_t data_start = 0;
+    if (version == 1 ? read_exact(&count, 8, fp) < 0 : tbf2_read_preamble(tf, fp, &count, &data_start) != T_OK)
+        goto fail;
+
     tensor_t *ts = (tensor_t *)calloc(count, sizeof(tensor_t));
     if (!ts)
+        goto fail;
+    tf->tensors = ts;
+    tf->count = count;
+    if (version == 2)
     {
-        fclose(fp);
-        return T_ERR;
+        tf->checksums = (uint32_t *)calloc(count, sizeof(uint32_t));
+        tf->index = (uint32_t *)calloc(tf->index_slots, sizeof(uint32_t));
+        if (!tf->checksums || !tf->index)
+            goto fail;
     }
+    if (mode == TBF_LOAD_MMAP && tbf_map(tf, fp) != T_OK)
+        goto fail;
 
+    // directory: name, dtype, shape, payload location (+ CRC-32 in TBF2)
     for (uint64_t i = 0; i < count; ++i)
     {
         uint16_t name_len;
-        if (read_exact(&name_len, 2, fp) < 0)
+        if (read_exact(&name_len, 2, fp) < 0 || name_len >= TENSOR_MAX_NAME_LEN)
             goto fail;
 
         if (read_exact(ts[i].name, name_len, fp) < 0)
@@ -51,7 +194,7 @@ t_status tbf_open(TbfFile *tf, const char *path)
 
         if (read_exact(&ts[i].dtype, 1, fp) < 0)
             goto fail;
-        if (read_exact(&ts[i].ndim, 1, fp) < 0)
+        if (read_exact(&ts[i].ndim, 1, fp) < 0 || ts[i].ndim > TENSOR_MAX_DIM)
             goto fail;
 
         if (read_exact(ts[i].dims, ts[i].ndim * 4, fp) < 0)
@@ -61,64 +204,128 @@ t_status tbf_open(TbfFile *tf, const char *path)
             goto fail;
         if (read_exact(&ts[i].nbytes, 8, fp) < 0)
             goto fail;
+        if (version == 2 && read_exact(&tf->checksums[i], 4, fp) < 0)
+            goto fail;
 
-        long prev_pos = ftell(fp);
+        uint64_t s = 1;
+        for (int j = ts[i].ndim - 1; j >= 0; --j)
+        {
+            ts[i].strides[j] = s;
+            s *= ts[i].dims[j];
+        }
+    }
+
+    if (version == 2)
+    {
+        if (read_exact(tf->index, tf->index_slots * sizeof(uint32_t), fp) < 0)
+            goto fail;
+        for (uint32_t s = 0; s < tf->index_slots; s++)
+            if (tf->index[s] > count)
+                goto fail;
+    }
+    else if (tbf_build_index(tf) != T_OK)
+        goto fail;
+
+    // payloads: zero-copy when mapped and float-aligned, a private copy otherwise
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        if (version == 2 && (ts[i].offset < data_start || ts[i].offset % TBF2_ALIGN != 0))
+            goto fail;
+        if (tf->map)
+        {
+            if (ts[i].offset > tf->map_size || ts[i].nbytes > tf->map_size - ts[i].offset)
+                goto fail;
+            if (ts[i].offset % sizeof(float) == 0)
+            {
+                ts[i].data = (float *)((uint8_t *)tf->map + ts[i].offset);
+                continue;
+            }
+        }
 
         void *buf = malloc(ts[i].nbytes);
         if (!buf)
             goto fail;
+        ts[i].data = buf;
         if (fseek(fp, (long)ts[i].offset, SEEK_SET) != 0)
             goto fail;
         if (read_exact(buf, (size_t)ts[i].nbytes, fp) < 0)
             goto fail;
-        ts[i].data = buf;
-        uint64_t s = 1;
-        for (int j = ts[i].ndim - 1; j >= 0; --j)
-        {
-            ts[i].strides[j] = s;
-            s *= ts[i].dims[j];
-        }
-        fseek(fp, prev_pos, SEEK_SET);
     }
 
-    *tf = (TbfFile){
-        .fp = fp,
-        .count = count,
-        .tensors = ts,
-    };
     return T_OK;
 
 fail:
     fprintf(stderr, "Failed to read TBF file\n");
+    tbf_close(*tf);
+    *tf = (TbfFile){0};
     return T_ERR;
 }
 
-static int64_t tbf_find_by_name(TbfFile tf, const char *name)
+t_status tbf_verify(TbfFile tf)
 {
+    if (!tf.checksums)
+        return T_OK; // TBF1 has nothing to check against
+    uint32_t table[256];
+    tbf_crc32_table(table);
     for (uint64_t i = 0; i < tf.count; ++i)
-        if (strcmp(tf.tensors[i].name, name) == 0)
-            return (int64_t)i;
-    return -1;
+    {
+        if (tbf_crc32(table, tf.tensors[i].data, tf.tensors[i].nbytes) != tf.checksums[i])
+        {
+            fprintf(stderr, "TBF checksum mismatch in %s\n", tf.tensors[i].name);
+            return T_ERR;
+        }
+    }
+    return T_OK;
 }
 
 tensor_t *tbf_get_tensor(TbfFile tf, const char *name)
 {
-    int64_t idx = tbf_find_by_name(tf, name);
-    if (idx < 0)
+    if (!tf.index_slots)
         return NULL;
-    tensor_t *t = &tf.tensors[idx];
-    return t;
+    const uint32_t mask = tf.index_slots - 1;
+    for (uint32_t s = tbf_name_hash(name) & mask, probes = 0; tf.index[s] && probes < tf.index_slots;
+         s = (s + 1) & mask, probes++)
+    {
+        tensor_t *t = &tf.tensors[tf.index[s] - 1];
+        if (strcmp(t->name, name) == 0)
+            return t;
+    }
+    return NULL;
+}
+
+t_status tbf_tensor_to_f32(TbfFile tf, tensor_t *t)
+{
+    if (t->dtype == 1)
+        return T_OK;
+    if (t->dtype != 2)
+        return T_ERR;
+    const size_t n = (size_t)(t->nbytes / sizeof(uint16_t));
+    float *buf = (float *)malloc(n * sizeof(float));
+    if (!buf)
+        return T_ERR;
+    const uint16_t *src = (const uint16_t *)t->data;
+    for (size_t i = 0; i < n; i++)
+        buf[i] = f16_to_f32(src[i]);
+    if (tbf_owns_data(tf, t))
+        free(t->data);
+    t->data = buf;
+    t->dtype = 1;
+    t->nbytes = n * sizeof(float);
+    return T_OK;
 }
 
 void tbf_close(TbfFile tf)
 {
     for (uint64_t i = 0; i < tf.count; ++i)
     {
-        if (tf.tensors[i].data)
+        if (tbf_owns_data(tf, &tf.tensors[i]))
             free(tf.tensors[i].data);
     }
-    if (tf.tensors)
-        free(tf.tensors);
+    free(tf.tensors);
+    free(tf.checksums);
+    free(tf.index);
+    if (tf.map)
+        munmap(tf.map, tf.map_size);
     if (tf.fp)
         fclose(tf.fp);
 }
@@ -126,7 +333,7 @@ void tbf_close(TbfFile tf)
 void tbf_print_tensors(TbfFile tf)
 {
     printf("========================================\n");
-    printf("TBF file contains %llu tensors: \n", (unsigned long long)tf.count);
+    printf("TBF%u file contains %llu tensors: \n", tf.version, (unsigned long long)tf.count);
     for (uint64_t i = 0; i < tf.count; ++i)
     {
         printf("%-50s (dtype=%d, ndim=%d, nbytes=%8llu, offset=%llu, shape=(", tf.tensors[i].name, tf.tensors[i].dtype, tf.tensors[i].ndim, tf.tensors[i].nbytes, tf.tensors[i].offset);
@@ -19,6 +19,7 @@ typedef enum
 //   torch.int64 : 4,
 //   torch.int32 : 5,
 //   torch.uint8 : 6,
+//   torch.int8 : 7,
 // }
 
 typedef struct
@@ -26,7 +27,7 @@ typedef struct
   uint64_t offset;
 
   char name[TENSOR_MAX_NAME_LEN]; // name of the tensor
-  uint8_t dtype;                  // dtype of the tensor (1: float32, 2: float16, 3: float64, 4: int64, 5: int32, 6: uint8)
+  uint8_t dtype;                  // dtype of the tensor (1: float32, 2: float16, 3: float64, 4: int64, 5: int32, 6: uint8, 7: int8)
   uint8_t ndim;
   uint32_t dims[TENSOR_MAX_DIM];
   uint64_t nbytes;
@@ -34,14 +35,74 @@ typedef struct
   uint64_t strides[TENSOR_MAX_DIM];
 } tensor_t;
 
+// File layout, all integers little-endian:
+//
+// TBF1: "TBF1" u64 count, then per tensor
+//         u16 name_len, name, u8 dtype, u8 ndim, u32 dims[ndim], u64 offset, u64 nbytes
+//       followed by the payloads at their absolute offsets.
+//
+// TBF2: "TBF2" u32 data_start, u64 count, u32 n_meta, u32 index_slots,
+//       n_meta x (u16 key_len, key, i64 value)   model hyperparameters, see tbf_meta_t
+//       count x (TBF1 tensor entry, u32 crc32)    CRC-32 (zlib) of the payload
+//       index_slots x u32                        open-addressed name directory: FNV-1a(name)
+//                                                & (index_slots - 1), linear probing,
+//                                                tensor index + 1, 0 = empty slot
+//       payloads from data_start on, each at a TBF2_ALIGN-aligned offset.
+//
+// scripts/tbf2.py writes TBF2 and converts TBF1 files.
+
+#define TBF2_ALIGN 64
+
+/// Model hyperparameters from the TBF2 metadata block; 0 = not recorded (always for TBF1)
+typedef struct
+{
+  uint32_t n_layers;
+  uint32_t n_heads;
+  uint32_t hidden_size;
+  uint32_t intermediate_size;
+  uint32_t vocab_size;
+  uint32_t max_positions;
+} tbf_meta_t;
+
 typedef struct
 {
   FILE *fp;
   uint64_t count;
   tensor_t *tensors;
+  void *map;       // read-only mapping of the whole file (TBF_LOAD_MMAP), NULL otherwise
+  size_t map_size;
+  uint32_t version;     // 1 or 2
+  tbf_meta_t meta;
+  uint32_t *checksums;  // [count] CRC-32 per payload, NULL for TBF1
+  uint32_t *index;      // [index_slots] name directory, built at load time for TBF1
+  uint32_t index_slots; // power of two
 } TbfFile;
 
+/// How tensor payloads are brought into memory
+typedef enum
+{
+  TBF_LOAD_COPY, // malloc + fread per tensor, private to the process
+  TBF_LOAD_MMAP, // tensor_t.data points into a read-only mapping of the file
+} tbf_load_t;
+
+/// @brief tbf_open_with(tf, path, TBF_LOAD_COPY)
 t_status tbf_open(TbfFile *tf, const char *path);
+
+/// @brief Open a TBF1 or TBF2 file.
+/// With TBF_LOAD_MMAP the weights are shared through the page cache by every process
+/// mapping the same file and are faulted in on first use; the data is read-only.
+/// Payloads whose file offset is not float-aligned are still copied.
+t_status tbf_open_with(TbfFile *tf, const char *path, tbf_load_t mode);
+
+/// @brief Check every payload against its TBF2 checksum (reads all weights; T_OK for TBF1)
+t_status tbf_verify(TbfFile tf);
+
+/// @brief Tensor by name through the hashed directory, NULL when absent
 tensor_t *tbf_get_tensor(TbfFile tf, const char *name);
+
+/// @brief Replace a float16 tensor of `tf` by a float32 copy, owned and freed by tbf_close.
+/// No-op for float32, T_ERR for other dtypes. The widened payload no longer matches its
+/// checksum, so call tbf_verify before.
+t_status tbf_tensor_to_f32(TbfFile tf, tensor_t *t);
 void tbf_close(TbfFile f);
 void tbf_print_tensors(TbfFile tf);
@@ -1,5 +1,8 @@
-// tensor.c — tiny, contiguous-only implementation
+// tensor.c — tiny tensor library: owned buffers, strided views, packed weights
 #include "tensor.h"
+#include "gemm.h"
+#include "kernels.h"
+#include "f16.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -12,6 +15,8 @@
 // alloca is available through stdlib.h on macOS
 #endif
 
+_Static_assert(TENSOR_PACK_NR == GEMM_NR, "packed weights must match the GEMM panel width");
+
 static uint32_t prod(const uint32_t *a, size_t n)
 {
     uint32_t p = 1;
@@ -24,68 +29,164 @@ t_status tensor_matmul(tensor_t *out, const tensor_t A, const tensor_t B)
 {
     if (A.ndim != 2 || B.ndim != 2)
         return -1;
-    uint32_t M = A.dims[0], K = A.dims[1], N = B.dims[1];
+    *out = (tensor_t){0};
+    return tensor_bmm(out, A, false, B, false, NULL);
+}
 
-    // Require contiguous layout (row-major).
-    if (!(A.strides[0] == K && A.strides[1] == 1 &&
-          B.strides[0] == N && B.strides[1] == 1))
-        return -2;
+// The last two axes of a 2-d or 3-d view as a gemm_operand_t; rows x cols of op(X).
+// Either axis may be the unit-stride one: a transposed view is read as stored.
+static t_status tensor_operand(gemm_operand_t *op, uint32_t *rows, uint32_t *cols, const tensor_t X, bool trans)
+{
+    if (X.ndim != 2 && X.ndim != 3)
+        return T_ERR;
+    const uint8_t r = X.ndim - 2, c = X.ndim - 1;
+    *op = (gemm_operand_t){.data = X.data, .stride = X.ndim == 3 && X.dims[0] > 1 ? X.strides[0] : 0};
+    if (X.strides[c] == 1 || X.dims[c] == 1)
+        op->ld = X.strides[r], op->trans = trans;
+    else if (X.strides[r] == 1 || X.dims[r] == 1)
+        op->ld = X.strides[c], op->trans = !trans;
+    else
+        return T_ERR;
+    *rows = trans ? X.dims[c] : X.dims[r];
+    *cols = trans ? X.dims[r] : X.dims[c];
+    return T_OK;
+}
 
-    *out = tensor_create(2, (uint32_t[]){M, N});
-    if (!(out->strides[0] == N && out->strides[1] == 1))
-        return -2;
+t_status tensor_bmm(tensor_t *out, const tensor_t A, bool trans_a, const tensor_t B, bool trans_b, pool_t *pool)
+{
+    gemm_operand_t a, b;
+    uint32_t M, K, K_b, N;
+    if (tensor_operand(&a, &M, &K, A, trans_a) != T_OK || tensor_operand(&b, &K_b, &N, B, trans_b) != T_OK ||
+        K != K_b)
+        return T_ERR;
+    const uint32_t batch_a = A.ndim == 3 ? A.dims[0] : 1, batch_b = B.ndim == 3 ? B.dims[0] : 1;
+    const uint32_t batch = batch_a > batch_b ? batch_a : batch_b;
+    if ((batch_a != 1 && batch_a != batch) || (batch_b != 1 && batch_b != batch))
+        return T_ERR;
 
-    const float *__restrict a = A.data; // [M,K]
-    const float *__restrict b = B.data; // [K,N]
-    float *__restrict c = out->data;    // [M,N]
+    const bool flat = A.ndim == 2 && B.ndim == 2;
+    if (flat ? tensor_ensure(out, 2, (uint32_t[]){M, N}) != T_OK
+             : tensor_ensure(out, 3, (uint32_t[]){batch, M, N}) != T_OK)
+        return T_ERR;
+    void *scratch = aligned_alloc(64, gemm_scratch_size(pool_size(pool)));
+    if (!scratch)
+        return T_ERR;
+    if (flat)
+        gemm_batched(1, M, N, K, a, b, out->data, out->strides[0], 0, scratch, pool);
+    else
+        gemm_batched(batch, M, N, K, a, b, out->data, out->strides[1], out->strides[0], scratch, pool);
+    free(scratch);
+    return T_OK;
+}
 
-    // Tune these for your cache/CPU. 128/128/64 is often good on modern x86; try 64s on smaller caches.
-    const size_t BM = 128, BN = 128, BK = 64;
+t_status tensor_pack_linear(tensor_packed_t *out, const tensor_t W)
+{
+    if (W.ndim != 2 || W.strides[0] != W.dims[1] || W.strides[1] != 1 || W.dtype > 2)
+        return T_ERR;
+    const uint32_t N = W.dims[0], K = W.dims[1];
+    if (W.dtype == 2)
+    {
+        // K * NR halves per panel is a multiple of 32 bytes; the size is rounded up for aligned_alloc
+        const size_t bytes = (gemm_packed_b_size(K, N) * sizeof(uint16_t) + 63) & ~(size_t)63;
+        uint16_t *p = (uint16_t *)aligned_alloc(64, bytes);
+        if (!p)
+            return T_ERR;
+        gemm_pack_b_f16(p, (const uint16_t *)W.data, K, N, K, true);
+        *out = (tensor_packed_t){.K = K, .N = N, .data_f16 = p};
+        return T_OK;
+    }
+    // K * NR floats per panel is always a multiple of 64 bytes, so every panel stays aligned.
+    float *p = (float *)aligned_alloc(64, gemm_packed_b_size(K, N) * sizeof(float));
+    if (!p)
+        return T_ERR;
+    gemm_pack_b(p, W.data, K, N, K, true);
 
-    // If you want multi-core, enable the pragma below and compile with -fopenmp.
-    // Parallelizing by (i0,j0) tiles avoids write races on C.
-    for (size_t i0 = 0; i0 < M; i0 += BM)
-        for (size_t j0 = 0; j0 < N; j0 += BN)
-        {
-            const size_t imax = (i0 + BM < M) ? (i0 + BM) : M;
-            const size_t jmax = (j0 + BN < N) ? (j0 + BN) : N;
+    *out = (tensor_packed_t){.K = K, .N = N, .data = p};
+    return T_OK;
+}
 
-            for (size_t k0 = 0; k0 < K; k0 += BK)
-            {
-                const size_t kmax = (k0 + BK < K) ? (k0 + BK) : K;
-
-                for (size_t i = i0; i < imax; ++i)
-                {
-                    float *__restrict c_row = c + i * (size_t)N + j0;
-
-                    for (size_t k = k0; k < kmax; ++k)
-                    {
-                        const float aik = a[i * (size_t)K + k];
-                        const float *__restrict b_row = b + k * (size_t)N + j0;
-
-                        // Inner j loop streams B and C rows (contiguous), good for caches & SIMD.
-                        size_t j = j0;
-                        // Unroll by 4 (simple, helps auto-vectorization)
-                        for (; j + 4 <= jmax; j += 4)
-                        {
-                            const size_t jj = j - j0;
-                            c_row[jj + 0] += aik * b_row[0];
-                            c_row[jj + 1] += aik * b_row[1];
-                            c_row[jj + 2] += aik * b_row[2];
-                            c_row[jj + 3] += aik * b_row[3];
-                            b_row += 4;
-                        }
-                        for (; j < jmax; ++j)
-                        {
-                            c_row[j - j0] += aik * (*b_row++);
-                        }
-                    }
-                }
-            }
-        }
+t_status tensor_quantize_linear(tensor_packed_t *out, const tensor_t W)
+{
+    if (W.ndim != 2 || W.strides[0] != W.dims[1] || W.strides[1] != 1 || W.dims[1] > GEMM_I8_KMAX || W.dtype > 2)
+        return T_ERR;
+    const uint32_t N = W.dims[0], K = W.dims[1];
+    const size_t padded = (N + GEMM_NR - 1) / GEMM_NR * GEMM_NR;
+    tensor_packed_t p = {
+        .K = K,
+        .N = N,
+        .data_i8 = (int8_t *)aligned_alloc(64, gemm_packed_b_i8_size(K, N)),
+        .scale_i8 = (float *)malloc(N * sizeof(float)),
+        .sum_i8 = (int32_t *)aligned_alloc(64, padded * sizeof(int32_t)),
+    };
+    // float16 weights are widened first; quantization only happens at load time
+    float *w = W.dtype == 2 ? (float *)malloc((size_t)N * K * sizeof(float)) : W.data;
+    if (!p.data_i8 || !p.scale_i8 || !p.sum_i8 || !w)
+    {
+        if (w != W.data)
+            free(w);
+        tensor_packed_destroy(&p);
+        return T_ERR;
+    }
+    if (W.dtype == 2)
+        for (size_t i = 0; i < (size_t)N * K; i++)
+            w[i] = f16_to_f32(((const uint16_t *)W.data)[i]);
+
+    gemm_quantize_b(p.data_i8, p.scale_i8, p.sum_i8, w, K, N, K);
+    if (w != W.data)
+        free(w);
+    *out = p;
+    return T_OK;
+}
+
+void tensor_packed_destroy(tensor_packed_t *p)
+{
+    free(p->data);
+    free(p->data_f16);
+    free(p->data_i8);
+    free(p->scale_i8);
+    free(p->sum_i8);
+    *p = (tensor_packed_t){0};
+}
+
+t_status tensor_matmul_packed(tensor_t *out, const tensor_t A, const tensor_packed_t B, const gemm_epilogue_t *epi,
+                              arena_t *scratch, pool_t *pool)
+{
+    if (A.ndim != 2 || A.dims[1] != B.K)
+        return -1;
+    const uint32_t M = A.dims[0], K = B.K, N = B.N;
+    if (!(A.strides[0] == K && A.strides[1] == 1))
+        return -2;
+
+    if (tensor_ensure(out, 2, (uint32_t[]){M, N}) != T_OK)
+        return T_ERR;
+    if (!B.data_i8 && M <= GEMM_SKINNY_MAX)
+    {
+        // the skinny GEMM reads A in place, nothing to pack
+        if (B.data_f16)
+            gemm_skinny_f16(M, N, K, A.data, K, B.data_f16, out->data, out->strides[0], epi, pool);
+        else
+            gemm_skinny(M, N, K, A.data, K, B.data, out->data, out->strides[0], epi, pool);
+        return T_OK;
+    }
 
-    return 0;
+    const size_t bytes = gemm_scratch_size(pool_size(pool));
+    const size_t mark = scratch ? arena_mark(scratch) : 0;
+    void *buf = scratch ? arena_alloc(scratch, bytes) : aligned_alloc(64, bytes);
+    if (!buf)
+        return T_ERR;
+    if (B.data_i8)
+        gemm_packed_i8(M, N, K, A.data, K, B.data_i8, B.scale_i8, B.sum_i8, out->data, out->strides[0], epi, buf, pool);
+    else if (B.data_f16)
+        gemm_packed_f16(M, N, K, A.data, K, B.data_f16, out->data, out->strides[0], epi, buf, pool);
+    else
+        gemm_packed(M, N, K, A.data, K, B.data, out->data, out->strides[0], epi, buf, pool);
+    if (scratch)
+        arena_rewind(scratch, mark);
+    else
+        free(buf);
+    return T_OK;
 }
+
 void tensor_print(const tensor_t t)
 {
     const size_t max_decimals = 4;
@@ -132,6 +233,21 @@ size_t tensor_numel(const tensor_t t)
         return 0;
     return prod(t.dims, t.ndim);
 }
+t_status tensor_ensure(tensor_t *out, uint32_t ndim, const uint32_t *dims)
+{
+    if (!out->data)
+    {
+        *out = tensor_create(ndim, (uint32_t *)dims);
+        return T_OK;
+    }
+    if (out->ndim != ndim || out->strides[ndim - 1] != 1)
+        return T_ERR;
+    for (uint32_t i = 0; i < ndim; i++)
+        if (out->dims[i] != dims[i])
+            return T_ERR;
+    return T_OK;
+}
+
 tensor_t tensor_view(uint8_t ndim, const uint32_t *dims, float *data)
 {
     uint64_t strides[ndim];
@@ -175,7 +291,9 @@ tensor_t tensor_slice(const tensor_t *t, int dim, uint64_t idx, bool keepdim)
             strides[i] = t->strides[i];
         }
         dims[dim] = 1;
-        return tensor_view(ndim, dims, base);
+        tensor_t view = tensor_view(ndim, dims, base);
+        memcpy(view.strides, strides, sizeof(uint64_t) * ndim);
+        return view;
     }
     else
     {
@@ -190,12 +308,57 @@ tensor_t tensor_slice(const tensor_t *t, int dim, uint64_t idx, bool keepdim)
             strides[j] = t->strides[i];
             ++j;
         }
-        return tensor_view(ndim - 1, dims, base);
+        tensor_t view = tensor_view(ndim - 1, dims, base);
+        memcpy(view.strides, strides, sizeof(uint64_t) * (ndim - 1));
+        return view;
+    }
+}
+
+// Cache tile of the transpose path: 64 x 64 floats, 16 KB on each side
+#define TENSOR_TRANSPOSE_TILE 64
+// Below this many elements a permute runs on the calling thread
+#define TENSOR_PERMUTE_PAR_MIN (1u << 16)
+
+// A permute whose unit-stride axis moves: every plane spanned by that axis and the
+// innermost output axis is a 2-d transpose, the remaining axes (up to two) enumerate planes
+typedef struct
+{
+    const kernels_t *kern;
+    float *out;
+    const float *in;
+    size_t rows, cols;          // of the source plane: rows along the output's inner axis
+    size_t lds, ldd;            // row stride of the source plane, of the output plane
+    uint8_t n_outer;            // remaining axes
+    uint32_t outer_dims[TENSOR_MAX_DIM];
+    uint64_t outer_in[TENSOR_MAX_DIM], outer_out[TENSOR_MAX_DIM];
+    size_t row_tiles;           // TENSOR_TRANSPOSE_TILE row tiles per plane
+} permute_job_t;
+
+// One task: one row tile of one plane, all of its column tiles
+static void permute_task(void *arg, size_t task)
+{
+    const permute_job_t *job = (const permute_job_t *)arg;
+    size_t plane = task / job->row_tiles;
+    const size_t i0 = (task % job->row_tiles) * TENSOR_TRANSPOSE_TILE;
+    uint64_t in_off = 0, out_off = 0;
+    for (int k = (int)job->n_outer - 1; k >= 0; --k)
+    {
+        const size_t c = plane % job->outer_dims[k];
+        plane /= job->outer_dims[k];
+        in_off += c * job->outer_in[k];
+        out_off += c * job->outer_out[k];
+    }
+    const size_t mr = job->rows - i0 < TENSOR_TRANSPOSE_TILE ? job->rows - i0 : TENSOR_TRANSPOSE_TILE;
+    for (size_t j0 = 0; j0 < job->cols; j0 += TENSOR_TRANSPOSE_TILE)
+    {
+        const size_t nc = job->cols - j0 < TENSOR_TRANSPOSE_TILE ? job->cols - j0 : TENSOR_TRANSPOSE_TILE;
+        job->kern->transpose(job->out + out_off + j0 * job->ldd + i0, job->ldd,
+                             job->in + in_off + i0 * job->lds + j0, job->lds, mr, nc);
     }
 }
 
 // Assumes float data; adapt T if needed.
-void tensor_permute_(tensor_t out, const tensor_t in, const uint8_t *perm)
+void tensor_permute_(tensor_t out, const tensor_t in, const uint8_t *perm, pool_t *pool)
 {
     const uint8_t nd = in.ndim;
 
@@ -278,6 +441,40 @@ void tensor_permute_(tensor_t out, const tensor_t in, const uint8_t *perm)
         return;
     }
 
+    // --- Fast path 3: tiled transpose (the input's unit-stride axis is output axis p) ---
+    uint8_t p = 0;
+    while (p < inner && in_step_for_out[p] != 1)
+        ++p;
+    if (out_unit && p < inner)
+    {
+        permute_job_t job = {
+            .kern = kernels_get(),
+            .out = out.data,
+            .in = in.data,
+            .rows = out.dims[inner],
+            .cols = out.dims[p],
+            .lds = in_step_for_out[inner],
+            .ldd = out.strides[p],
+        };
+        size_t planes = 1;
+        for (uint8_t k = 0; k < inner; ++k)
+        {
+            if (k == p)
+                continue;
+            job.outer_dims[job.n_outer] = out.dims[k];
+            job.outer_in[job.n_outer] = in_step_for_out[k];
+            job.outer_out[job.n_outer] = out.strides[k];
+            job.n_outer++;
+            planes *= out.dims[k];
+        }
+        job.row_tiles = (job.rows + TENSOR_TRANSPOSE_TILE - 1) / TENSOR_TRANSPOSE_TILE;
+        const size_t numel = planes * job.rows * job.cols;
+        if (numel == 0)
+            return;
+        pool_run(numel >= TENSOR_PERMUTE_PAR_MIN ? pool : NULL, planes * job.row_tiles, permute_task, &job);
+        return;
+    }
+
     // --- Generic, division-free odometer (one element at a time) ---
     uint32_t coord[TENSOR_MAX_DIM] = {0};
 
@@ -328,7 +525,7 @@ void tensor_permute_(tensor_t out, const tensor_t in, const uint8_t *perm)
         (b) = _tmp;               \
     } while (0)
 
-t_status tensor_permute(tensor_t *out, const tensor_t in, uint8_t d0, uint8_t d1)
+t_status tensor_permute(tensor_t *out, const tensor_t in, uint8_t d0, uint8_t d1, pool_t *pool)
 {
     uint8_t perm[TENSOR_MAX_DIM] = {0, 1, 2, 3};
     const uint8_t nd = in.ndim;
@@ -344,15 +541,14 @@ t_status tensor_permute(tensor_t *out, const tensor_t in, uint8_t d0, uint8_t d1
     memcpy(dims, in.dims, sizeof(uint32_t) * in.ndim);
     m_swap(dims[d0], dims[d1]);
     *out = tensor_create(in.ndim, dims);
-    tensor_permute_(*out, in, perm);
+    tensor_permute_(*out, in, perm, pool);
     return T_OK;
 }
 
 float tensor_sum(tensor_t t)
 {
     float sum = 0.0f;
-    for (size_t i = 0; i < prod(t.dims, t.ndim); i++)
-        sum += t.data[i];
+    TENSOR_MAP(i, tensor_numel(t), sum += t.data[i]);
     return sum;
 }
 
@@ -405,100 +601,188 @@ void tensor_destroy(tensor_t *t)
     t->ndim = 0;
 }
 
-static inline float op_neg(float x, float *op_param) { return -x; }
-static inline float op_exp(float x, float *op_param) { return expf(x); }
-static inline float op_log(float x, float *op_param) { return logf(x); }
-static inline float op_abs(float x, float *op_param) { return fabsf(x); }
-static inline float op_scale(float x, float *op_param) { return x * op_param[0]; }
-static inline float op_pow(float x, float *op_param) { return powf(x, op_param[0]); }
-static inline float op_sub(float x, float *op_param) { return x - op_param[0]; }
-static inline float op_gelu(float x, float *op_param)
-{
-    return 0.5f * x * (1.0f + tanhf(0.7978845608028654f * (x + 0.044715f * powf(x, 3.0f))));
-}
-typedef float (*unary_op_t)(float x, float *op_param);
-
-static unary_op_t unary_op_table[UOP_COUNT] = {op_neg, op_exp, op_log, op_gelu, op_abs, op_scale, op_sub, op_pow};
+// ---------------------------------------------------------------------------
+// Elementwise engine
+//
+// Each op is an expression over the element `x`, the other operand `y` (binary) and
+// the scalar parameter `p` (unary). The X-macros below stamp out one loop per
+// (op, broadcast pattern, stride pattern); the op is picked by a switch outside the
+// loop, so the body is inlined and the contiguous variants vectorize.
+
+#define TENSOR_UNARY_OPS(X)       \
+    X(U_NEG, -x)                  \
+    X(U_LOG, logf(x))             \
+    X(U_ABS, fabsf(x))            \
+    X(U_SCALE, x *p)              \
+    X(U_SUB, x - p)               \
+    X(U_POW, powf(x, p))
+
+#define TENSOR_BINARY_OPS(X) \
+    X(B_ADD, x + y)          \
+    X(B_SUB, x - y)          \
+    X(B_MUL, x *y)           \
+    X(B_DIV, x / y)
+
+#define DEFINE_UNARY(op, expr)                           \
+    static void op##_loop(float *a, size_t n, float p)   \
+    {                                                    \
+        (void)p;                                         \
+        TENSOR_MAP(i, n, {                               \
+            const float x = a[i];                        \
+            a[i] = (expr);                               \
+        });                                              \
+    }
+TENSOR_UNARY_OPS(DEFINE_UNARY)
+#undef DEFINE_UNARY
+
+// vv: both operands contiguous; vs: `other` broadcast along the row; strided: anything else
+#define DEFINE_BINARY(op, expr)                                                            \
+    static void op##_vv(float *out, const float *other, size_t n)                          \
+    {                                                                                      \
+        TENSOR_MAP(i, n, {                                                                 \
+            const float x = out[i], y = other[i];                                          \
+            out[i] = (expr);                                                               \
+        });                                                                                \
+    }                                                                                      \
+    static void op##_vs(float *out, const float *other, size_t n)                          \
+    {                                                                                      \
+        const float y = *other;                                                            \
+        TENSOR_MAP(i, n, {                                                                 \
+            const float x = out[i];                                                        \
+            out[i] = (expr);                                                               \
+        });                                                                                \
+    }                                                                                      \
+    static void op##_strided(float *out, size_t so, const float *other, size_t sb, size_t n) \
+    {                                                                                      \
+        TENSOR_MAP(i, n, {                                                                 \
+            const float x = out[i * so], y = other[i * sb];                                \
+            out[i * so] = (expr);                                                          \
+        });                                                                                \
+    }
+TENSOR_BINARY_OPS(DEFINE_BINARY)
+#undef DEFINE_BINARY
 
 void tensor_unary_op(tensor_t a, uop_t op, float *op_param)
 {
     assert(op < UOP_COUNT);
-    const uint64_t N = tensor_numel(a);
-    unary_op_t op_func = unary_op_table[op];
-    float *x = a.data; // [N]
+    const size_t n = tensor_numel(a);
+    const float p = op_param ? op_param[0] : 0.0f;
 
-    for (uint64_t i = 0; i < N; i++)
-        x[i] = op_func(x[i], op_param);
+    switch (op)
+    {
+    // transcendental ops go through the per-ISA kernels
+    case U_EXP:
+        kernels_get()->exp(a.data, n);
+        return;
+    case U_GELU:
+        kernels_get()->gelu(a.data, n);
+        return;
+    case U_POW:
+        if (p == 2.0f)
+        {
+            B_MUL_vv(a.data, a.data, n);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    switch (op)
+    {
+#define CASE_UNARY(op, expr)      \
+    case op:                      \
+        op##_loop(a.data, n, p);  \
+        return;
+        TENSOR_UNARY_OPS(CASE_UNARY)
+#undef CASE_UNARY
+    default:
+        assert(false);
+    }
 }
 
-static float binop_addf(float x, float y) { return x + y; }
-static float binop_subf(float x, float y) { return x - y; }
-static float binop_mulf(float x, float y) { return x * y; }
-static float binop_divf(float x, float y) { return x / y; }
-typedef float (*bop_fn)(float, float);
-static bop_fn bop_table[BOP_COUNT] = {binop_addf, binop_subf, binop_mulf, binop_divf};
+typedef enum
+{
+    ROW_VV,      // contiguous rows on both sides
+    ROW_VS,      // contiguous output row, `other` is one value per row
+    ROW_STRIDED, // anything else
+} row_pattern_t;
 
-static inline bool is_lastdim_bias(const tensor_t out, const tensor_t other)
+static void binary_row(bop_t op, row_pattern_t pattern, float *out, size_t so, const float *other, size_t sb, size_t n)
 {
-    // check if first n-1 dims are single element
-    for (uint64_t i = 0; i < other.ndim - 1; i++)
+    switch (op)
     {
-        if (other.dims[i] != 1)
-            return false;
+#define CASE_BINARY(op, expr)                          \
+    case op:                                           \
+        if (pattern == ROW_VV)                         \
+            op##_vv(out, other, n);                    \
+        else if (pattern == ROW_VS)                    \
+            op##_vs(out, other, n);                    \
+        else                                           \
+            op##_strided(out, so, other, sb, n);       \
+        return;
+        TENSOR_BINARY_OPS(CASE_BINARY)
+#undef CASE_BINARY
+    default:
+        assert(false);
     }
-    // and the last dim is the same as the other dims
-    if (other.dims[other.ndim - 1] != out.dims[out.ndim - 1])
-        return false;
-    return true;
 }
 
-static inline bool is_same_shape(const tensor_t out, const tensor_t other)
+static bool is_contiguous(const tensor_t t)
 {
-    for (uint64_t i = 0; i < out.ndim; i++)
+    uint64_t s = 1;
+    for (int i = t.ndim - 1; i >= 0; --i)
     {
-        if (out.dims[i] != other.dims[i])
+        if (t.dims[i] != 1 && t.strides[i] != s)
             return false;
+        s *= t.dims[i];
     }
     return true;
 }
 
-void tensor_binary_broadcast(tensor_t out, const tensor_t other, bop_t op)
+void tensor_binary_op(tensor_t out, const tensor_t other, bop_t op)
 {
-    // bias on last dimension: out:[..., N], other:[N]
-    assert(is_lastdim_bias(out, other));
-    bop_fn op_func = bop_table[op];
-    uint64_t n_out = tensor_numel(out);
-    uint64_t n_other = tensor_numel(other);
-
-    const uint64_t N = other.dims[0];
-    const uint64_t rows = (N ? n_out / N : 0);
-    float *__restrict y = out.data;
-    const float *__restrict b = other.data;
-
-    for (uint64_t r = 0; r < rows; ++r)
+    assert(op < BOP_COUNT);
+    assert(other.ndim <= out.ndim);
+    const size_t n = tensor_numel(out);
+    if (n == 0)
+        return;
+
+    // right-align `other` against `out`; broadcast axes get stride 0 (numpy rules)
+    uint64_t bstrides[TENSOR_MAX_DIM] = {0};
+    const int lead = out.ndim - other.ndim;
+    bool same_shape = lead == 0;
+    for (int i = 0; i < other.ndim; i++)
     {
-        uint64_t base = r * N;
-        for (uint64_t j = 0; j < N; ++j)
-            y[base + j] = op_func(y[base + j], b[j]);
+        const uint32_t d = other.dims[i];
+        assert(d == out.dims[lead + i] || d == 1);
+        bstrides[lead + i] = d == 1 ? 0 : other.strides[i];
+        same_shape &= d == out.dims[lead + i];
     }
-}
 
-void tensor_binary_op(tensor_t out, const tensor_t other, bop_t op)
-{
-    bool can_broadcast = is_lastdim_bias(out, other);
-    bool same_shape = is_same_shape(out, other);
-
-    if (same_shape)
+    // whole tensor in one call
+    if (is_contiguous(out) && (same_shape ? is_contiguous(other) : tensor_numel(other) == 1))
     {
-        bop_fn op_func = bop_table[op];
-        for (uint64_t i = 0; i < tensor_numel(out); i++)
-            out.data[i] = op_func(out.data[i], other.data[i]);
+        binary_row(op, same_shape ? ROW_VV : ROW_VS, out.data, 1, other.data, 0, n);
         return;
     }
-    else if (can_broadcast)
+
+    // otherwise one call per row of the last axis, walking the outer axes by strides
+    const int last = out.ndim - 1;
+    const size_t len = out.dims[last];
+    const size_t so = out.strides[last], sb = bstrides[last];
+    const row_pattern_t pattern = so != 1 ? ROW_STRIDED : sb == 1 ? ROW_VV : sb == 0 ? ROW_VS : ROW_STRIDED;
+    uint32_t idx[TENSOR_MAX_DIM] = {0};
+    for (size_t r = 0, rows = n / len; r < rows; r++)
     {
-        tensor_binary_broadcast(out, other, op);
-        return;
+        uint64_t oo = 0, ob = 0;
+        for (int i = 0; i < last; i++)
+        {
+            oo += idx[i] * out.strides[i];
+            ob += idx[i] * bstrides[i];
+        }
+        binary_row(op, pattern, out.data + oo, so, other.data + ob, sb, len);
+        for (int i = last - 1; i >= 0 && ++idx[i] == out.dims[i]; i--)
+            idx[i] = 0;
     }
-    assert(false);
 }
@@ -2,6 +2,9 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include "tbf.h"
+#include "pool.h"
+#include "gemm.h"
+#include "arena.h"
 
 #define TENSOR_MAX_DIM 4
 
@@ -10,12 +13,86 @@ tensor_t tensor_copy(tensor_t t);
 tensor_t tensor_create(uint32_t ndim, uint32_t *dims);
 void tensor_destroy(tensor_t *t);
 tensor_t tensor_view(uint8_t ndim, const uint32_t *dims, float *base_data);
-t_status tensor_permute(tensor_t *out, const tensor_t in, uint8_t d0, uint8_t d1);
+
+/// @brief Output tensor of an op taking `tensor_t *out`
+///
+/// With `out->data == NULL` a new tensor is created (owned by the caller). Otherwise
+/// `out` is a caller-provided buffer (arena, view) written in place: it must have shape
+/// `dims` and unit stride on the last axis, or T_ERR is returned.
+t_status tensor_ensure(tensor_t *out, uint32_t ndim, const uint32_t *dims);
+/// @brief Swap axes d0 and d1 of `in` into a new contiguous tensor
+/// When the unit-stride axis moves, every plane of it and the new innermost axis is a tiled
+/// 2-d transpose on the kernel table's register blocks; large permutes are split across
+/// `pool` (may be NULL).
+t_status tensor_permute(tensor_t *out, const tensor_t in, uint8_t d0, uint8_t d1, pool_t *pool);
 tensor_t tensor_slice(const tensor_t *t, int dim, uint64_t idx, bool keepdim);
 
-/// @brief 2d matmul: C[M, N] = A[M, K] x B[K, N]
+/// @brief 2d matmul: C[M, N] = A[M, K] x B[K, N] into a new tensor; A and B may be strided views
 t_status tensor_matmul(tensor_t *out, const tensor_t A, const tensor_t B);
 
+/// @brief Batched matmul on views, no copies: out[b] = op(A[b]) x op(B[b]), op(X) = trans ? X^T : X
+///
+/// A and B are [rows, cols] (shared by every batch entry) or [batch, rows, cols] views with
+/// any batch and row strides, e.g. head slices of a [S, 3 * HIDDEN] buffer; a transposed
+/// view (unit stride on rows instead of columns) is read as is. `out` is [batch, M, N], or
+/// [M, N] when both inputs are 2-d, and follows tensor_ensure, so it can be a view as well.
+/// Runs on gemm_batched, split across `pool` (may be NULL).
+t_status tensor_bmm(tensor_t *out, const tensor_t A, bool trans_a, const tensor_t B, bool trans_b, pool_t *pool);
+
+/// @brief Column panel width of packed weights: 16 floats, one 64-byte cache line per k
+#define TENSOR_PACK_NR 16
+
+/// @brief B[K, N] repacked once for GEMM.
+///
+/// Columns are split into ceil(N / TENSOR_PACK_NR) panels, each stored as
+/// [K, TENSOR_PACK_NR] row-major, 64-byte aligned, with the tail panel zero-filled.
+/// FP16 weights keep their width and quantized ones are int8: exactly one of `data`,
+/// `data_f16` and `data_i8` is set, and tensor_matmul_packed picks the matching GEMM.
+typedef struct
+{
+    uint32_t K;
+    uint32_t N;
+    float *data;
+    uint16_t *data_f16; // IEEE half panels, widened inside the GEMM (gemm_packed_f16)
+    int8_t *data_i8;    // int8 panels from tensor_quantize_linear (gemm_packed_i8)
+    float *scale_i8;    // [N] per output channel scales of data_i8
+    int32_t *sum_i8;    // column sums of data_i8, one per padded column
+} tensor_packed_t;
+
+/// @brief Pack a linear layer weight W[N, K] (PyTorch layout) as B = W^T
+/// A float16 W (dtype 2) is packed as FP16, a float32 one (dtype 1, or 0 from tensor_create) as FP32;
+/// other dtypes are rejected.
+t_status tensor_pack_linear(tensor_packed_t *out, const tensor_t W);
+
+/// @brief Quantize a linear layer weight W[N, K] (float32 or float16) to int8 with one
+/// scale per output channel. Activations are then quantized per row at run time, so the
+/// layer runs an int8 x int8 -> int32 GEMM. T_ERR when K > GEMM_I8_KMAX.
+t_status tensor_quantize_linear(tensor_packed_t *out, const tensor_t W);
+void tensor_packed_destroy(tensor_packed_t *p);
+
+/// @brief 2d matmul against packed weights: C[M, N] = A[M, K] x B[K, N], split across `pool` (may be NULL)
+/// `epi` (may be NULL) is fused into the GEMM, see gemm_epilogue_t; `out` follows tensor_ensure.
+/// Float weights take the skinny GEMM for M <= GEMM_SKINNY_MAX (short single queries).
+/// The GEMM's packing buffers (gemm_scratch_size) come from `scratch` and are released
+/// before returning; with a NULL `scratch` they are allocated for the call.
+t_status tensor_matmul_packed(tensor_t *out, const tensor_t A, const tensor_packed_t B, const gemm_epilogue_t *epi,
+                              arena_t *scratch, pool_t *pool);
+
+/// @brief Fused elementwise loop, expanded inline at the call site
+///
+/// Runs `body` for every `i` in [0, n) with `n` evaluated once, so a chain such as
+/// `TENSOR_MAP(i, n, y[i] = (x[i] - mean) * inv_std * gamma[i] + beta[i]);`
+/// is a single vectorizable pass with one store per element.
+#define TENSOR_MAP(i, n, ...)                  \
+    do                                         \
+    {                                          \
+        const size_t i##_end__ = (n);          \
+        for (size_t i = 0; i < i##_end__; i++) \
+        {                                      \
+            __VA_ARGS__;                       \
+        }                                      \
+    } while (0)
+
 /// @brief Binary operation type
 typedef enum bop_t bop_t;
 
@@ -24,9 +101,9 @@ typedef enum bop_t bop_t;
 /// @param out    Output tensor (modified in-place)
 /// @param other  Second operand tensor
 /// @param op     Binary operation: B_ADD, B_SUB, B_MUL, B_DIV
-/// @return       T_OK on success, T_ERR if tensors have different sizes
 ///
-/// Both tensors must have the same number of elements.
+/// `other` broadcasts against `out` with numpy rules (dims right-aligned, each equal
+/// or 1); either side may be a strided view.
 void tensor_binary_op(tensor_t out, const tensor_t other, bop_t op);
 
 /// @brief Supported binary operations
@@ -46,6 +46,7 @@ int tokenizer_create(tokenizer_t *tok, const char *vocab_txt_path)
             if (ret != 0)
             {
                 fprintf(stderr, "Failed to insert token\n");
+                fclose(fp);
                 return 1;
             }
         }
@@ -76,6 +77,7 @@ int tokenizer_encode(const tokenizer_t tok, uint8_t *text, int text_len, da_u32
         const trie_t *node = trie_longest(tok.trie, part.data, part.len, &depth);
         if (node == NULL)
         {
+            da_s8_free(&parts);
             return 1;
         }
         da_u32_append(out_ids, node->value);
@@ -88,6 +90,7 @@ int tokenizer_encode(const tokenizer_t tok, uint8_t *text, int text_len, da_u32
         const trie_t *cont_node = trie_longest(*continuation_tree, part.data + depth, remaining_len, &depth);
         if (cont_node == NULL)
         {
+            da_s8_free(&parts);
             return 1;
         }
         da_u32_append(out_ids, cont_node->value);
@@ -4,6 +4,7 @@ import java.io.File;
 import java.io.IOException;
 import java.nio.file.Files;
 import java.nio.file.StandardCopyOption;
+import java.util.Arrays;
 
 /**
  * MiniLM embeddings model - JNI wrapper around C implementation.
@@ -11,19 +12,40 @@ import java.nio.file.StandardCopyOption;
  */
 public final class MiniLM implements AutoCloseable {
 
+  /** Length of every embedding vector. */
+  public static final int EMBEDDING_SIZE = 384;
+
+  /** Most texts per native call: the flat result array holds this many embeddings. */
+  private static final int MAX_NATIVE_BATCH = Integer.MAX_VALUE / EMBEDDING_SIZE;
+
   private static boolean libraryLoaded = false;
   private final long sessionHandle;
 
   /**
-   * Create a new MiniLM session.
+   * Create a new single-threaded MiniLM session.
    *
    * @param tbfPath   Path to the BERT weights file (.tbf)
    * @param vocabPath Path to the vocabulary file (vocab.txt)
    * @throws RuntimeException if session creation fails
    */
   public MiniLM(String tbfPath, String vocabPath) {
+    this(tbfPath, vocabPath, 1);
+  }
+
+  /**
+   * Create a new MiniLM session with a native worker pool.
+   *
+   * @param tbfPath   Path to the BERT weights file (.tbf)
+   * @param vocabPath Path to the vocabulary file (vocab.txt)
+   * @param threads   Threads used per embed call: 0 for all CPUs, 1 for single-threaded
+   * @throws RuntimeException if session creation fails
+   */
+  public MiniLM(String tbfPath, String vocabPath, int threads) {
+    if (threads < 0) {
+      throw new IllegalArgumentException("Thread count cannot be negative");
+    }
     loadLibrary();
-    long handle = nCreate(tbfPath, vocabPath);
+    long handle = nCreate(tbfPath, vocabPath, threads);
     if (handle == 0) {
       throw new RuntimeException("Failed to create MiniLM session");
     }
@@ -31,10 +53,12 @@ public final class MiniLM implements AutoCloseable {
   }
 
   // Native method declarations
-  private static native long nCreate(String tbfPath, String vocabPath);
+  private static native long nCreate(String tbfPath, String vocabPath, int threads);
 
   private static native float[] nEmbed(long sessionHandle, String text);
 
+  private static native float[] nEmbedBatch(long sessionHandle, String[] texts, int tokenBudget);
+
   private static native void nDestroy(long sessionHandle);
 
   private static synchronized void loadLibrary() {
@@ -106,6 +130,58 @@ public final class MiniLM implements AutoCloseable {
     return result;
   }
 
+  /**
+   * Generate embeddings for several texts, batched natively.
+   * Sharing the weight reads across the batch makes this much faster than
+   * calling {@link #embed(String)} in a loop for bulk workloads.
+   *
+   * @param texts Input texts to embed
+   * @return One float[384] embedding per text, in input order
+   * @throws IllegalArgumentException if texts or any element is null
+   * @throws RuntimeException if embedding generation fails
+   */
+  public float[][] embedBatch(String[] texts) {
+    return embedBatch(texts, 0);
+  }
+
+  /**
+   * Generate embeddings for several texts, batched natively. Texts are grouped
+   * by token count into encoder batches of at most {@code tokenBudget} tokens,
+   * which bounds native memory use for very large inputs.
+   *
+   * @param texts       Input texts to embed
+   * @param tokenBudget Max tokens per encoder batch, 0 for the library default
+   * @return One float[384] embedding per text, in input order
+   * @throws IllegalArgumentException if texts or any element is null
+   * @throws RuntimeException if embedding generation fails
+   */
+  public float[][] embedBatch(String[] texts, int tokenBudget) {
+    if (texts == null) {
+      throw new IllegalArgumentException("Texts cannot be null");
+    }
+    if (tokenBudget < 0) {
+      throw new IllegalArgumentException("Token budget cannot be negative");
+    }
+    if (texts.length == 0) {
+      return new float[0][];
+    }
+
+    // the native call returns one flat array, so its length must fit in an int
+    float[][] result = new float[texts.length][];
+    for (int first = 0; first < texts.length; first += MAX_NATIVE_BATCH) {
+      String[] chunk = texts.length <= MAX_NATIVE_BATCH
+          ? texts : Arrays.copyOfRange(texts, first, Math.min(texts.length, first + MAX_NATIVE_BATCH));
+      float[] flat = nEmbedBatch(sessionHandle, chunk, tokenBudget);
+      if (flat == null || flat.length != chunk.length * EMBEDDING_SIZE) {
+        throw new RuntimeException("Failed to generate embeddings");
+      }
+      for (int i = 0; i < chunk.length; i++) {
+        result[first + i] = Arrays.copyOfRange(flat, i * EMBEDDING_SIZE, (i + 1) * EMBEDDING_SIZE);
+      }
+    }
+    return result;
+  }
+
   @Override public void close() {
     if (sessionHandle != 0) {
       nDestroy(sessionHandle);